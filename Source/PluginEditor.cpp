@@ -20,6 +20,7 @@ ProcessorstateAudioProcessorEditor::ProcessorstateAudioProcessorEditor (Processo
     setSize (400, 300);
 
     fileState = dynamic_cast<ProcessorStateFile*>(p.state.getData("file"));
+    fileState->ensureLoaded();
     fileState->addListener(this);
     updateButtonText();
     file.addListener(this);
@@ -53,7 +54,10 @@ void ProcessorstateAudioProcessorEditor::buttonClicked (Button*)
     FileChooser chooser{ "Find audio" };
 
     if (chooser.browseForFileToOpen())
+    {
         fileState->setFile(chooser.getResult(), sendNotification);
+        processor.state.getUndoHistory()->checkpoint();
+    }
 }
 
 void ProcessorstateAudioProcessorEditor::processorStateDataChanged (const String&)
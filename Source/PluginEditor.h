@@ -35,7 +35,7 @@ private:
 
     ProcessorstateAudioProcessor& processor;
     Slider volumeSlider;
-    ProcessorState::SliderAttachment volumeAttachment{ processor.state, "volume", volumeSlider };
+    ProcessorState::SliderAttachment volumeAttachment{ processor.parameters[ExampleParameters::volume], volumeSlider };
 
     TextButton file;
     ProcessorStateFile * fileState;
@@ -11,6 +11,7 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
+constexpr ProcessorState::ParameterDescriptor ExampleParameters::descriptors[];
 
 //==============================================================================
 ProcessorstateAudioProcessor::ProcessorstateAudioProcessor()
@@ -25,36 +26,34 @@ ProcessorstateAudioProcessor::ProcessorstateAudioProcessor()
                        )
 #endif
 {
-    volumeValue = &state.createAndAddParameter("volume", "volume", "Volume", { 0.0, 2.0 }, { 1.0 }, nullptr, nullptr)->value;
+    parameters.setSmoothing(ExampleParameters::volume, ProcessorStateSmoother::linear, 0.05);
 
-    auto onFileUpdated = [this](const File & file)
+    // Hosts may restore the state several times while a project opens, so
+    // only decode the sample once they've settled.
+    state.setLazyLoading(true);
+
+    // Runs on whichever thread is loading.  The decoded file comes from the
+    // cache shared by every instance, and is handed to the audio thread by the
+    // ProcessorStateLoadedFile, so there's no locking here.
+    auto loadSample = [this](const File & file) -> std::unique_ptr<ProcessorStateSampleCache::SamplePtr>
     {
-        // some sort of thread-safe file action here!
         DBG("loading ... " + file.getFullPathName());
 
-        AudioFormatManager afm;
-        afm.registerBasicFormats();
-        ScopedPointer<AudioFormatReader> reader = afm.createReaderFor(file);
-
-        if (reader)
-        {
-            ScopedPointer<AudioSampleBuffer> buffer = new AudioBuffer<float>(reader->numChannels, int(reader->lengthInSamples));
-            reader->read(buffer, 0, buffer->getNumSamples(), 0, true, true);
-
-            {
-                ScopedLock lock(processBlockLock);
-                sample = buffer.release();
+        auto sample = sampleCache->getSample(file);
 
-                DBG("loaded ok");
-            }
-        }
-        else
+        if (sample == nullptr)
         {
             DBG("load failed");
+            return nullptr;
         }
+
+        DBG("loaded ok");
+        return std::unique_ptr<ProcessorStateSampleCache::SamplePtr>(new ProcessorStateSampleCache::SamplePtr(sample));
     };
 
-    state.addData(new ProcessorStateFile(state, "file", onFileUpdated));
+    sampleFile = new ProcessorStateLoadedFile<ProcessorStateSampleCache::SamplePtr>(state, "file", loadSample);
+    state.addData(sampleFile);
+    state.enableUndo();
 }
 
 ProcessorstateAudioProcessor::~ProcessorstateAudioProcessor()
@@ -128,6 +127,7 @@ void ProcessorstateAudioProcessor::prepareToPlay (double sampleRate, int samples
 {
     // Use this method as the place to do any pre-playback
     // initialisation that you need..
+    state.prepareToPlay(sampleRate, samplesPerBlock);
 }
 
 void ProcessorstateAudioProcessor::releaseResources()
@@ -162,9 +162,6 @@ bool ProcessorstateAudioProcessor::isBusesLayoutSupported (const BusesLayout& la
 
 void ProcessorstateAudioProcessor::processBlock (AudioSampleBuffer& buffer, MidiBuffer& midiMessages)
 {
-    if (!processBlockLock.tryEnter())
-        return;
-
     ScopedNoDenormals noDenormals;
     const int totalNumInputChannels  = getTotalNumInputChannels();
     const int totalNumOutputChannels = getTotalNumOutputChannels();
@@ -181,11 +178,60 @@ void ProcessorstateAudioProcessor::processBlock (AudioSampleBuffer& buffer, Midi
     auto data = buffer.getArrayOfWritePointers();
     auto numSamples = buffer.getNumSamples();
 
-    for (int channel = 0; channel < totalNumInputChannels; ++channel)
-        for (int i = 0; i < numSamples; ++i)
-            data[channel][i] = *volumeValue * Random::getSystemRandom().nextFloat();
+    // We're being played, so don't wait for the settle time.
+    if (sampleFile->hasPendingLoad())
+        sampleFile->requestLoad();
+
+    // Holds on to whichever sample is current for the rest of the block,
+    // without locking.
+    ProcessorStatePayload<ProcessorStateSampleCache::SamplePtr>::Reader sample (sampleFile->getPayload());
+    const ProcessorStateCompactSample* sampleData = sample ? sample->get() : nullptr;
+    const int64 sampleLength = (sampleData != nullptr && sampleData->getNumChannels() > 0) ? sampleData->getLengthInSamples() : 0;
+
+    // The smoothing ramps are only as long as the block size we were
+    // prepared with, so work through bigger blocks in pieces.
+    const int maxBlockSize = jmax(1, getBlockSize());
 
-    processBlockLock.exit();
+    for (int start = 0; start < numSamples; start += maxBlockSize)
+    {
+        const int num = jmin(maxBlockSize, numSamples - start);
+
+        state.updateSmoothing(num);
+        auto volume = parameters.getSmoothed(ExampleParameters::volume);
+
+        if (sampleLength > 0)
+        {
+            // Loop the sample, or play noise if there isn't one.
+            samplePosition %= sampleLength;
+
+            for (int channel = 0; channel < totalNumInputChannels; ++channel)
+            {
+                float* dest = data[channel] + start;
+                int64 position = samplePosition;
+
+                // Converted straight into the output, up to the end of the
+                // sample at a time.
+                for (int i = 0; i < num;)
+                {
+                    const int count = int(jmin(int64(num - i), sampleLength - position));
+                    sampleData->read(channel % sampleData->getNumChannels(), position, dest + i, count);
+                    i += count;
+                    position = (position + count) % sampleLength;
+                }
+
+                for (int i = 0; i < num; ++i)
+                    dest[i] *= volume[i];
+            }
+
+            samplePosition = (samplePosition + num) % sampleLength;
+        }
+        else
+        {
+            for (int channel = 0; channel < totalNumInputChannels; ++channel)
+                for (int i = 0; i < num; ++i)
+                    data[channel][start + i] = volume[i] * Random::getSystemRandom().nextFloat();
+        }
+    }
 }
 
 //==============================================================================
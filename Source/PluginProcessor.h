@@ -12,8 +12,25 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "ProcessorState.h"
+#include "ProcessorStateSampleCache.h"
 
 
+//==============================================================================
+/** The parameters of the example processor. */
+struct ExampleParameters
+{
+    enum Index
+    {
+        volume,
+        numParameters
+    };
+
+    static constexpr ProcessorState::ParameterDescriptor descriptors[numParameters]
+    {
+        { "volume", "volume", "Volume", 1.0f, 0.0f, 2.0f }
+    };
+};
+
 //==============================================================================
 /**
 */
@@ -58,11 +75,12 @@ public:
     void setStateInformation (const void* data, int sizeInBytes) override;
 
     ProcessorState state{ *this };
+    ProcessorState::ParameterSet<ExampleParameters> parameters{ state };
 
 private:
-    CriticalSection processBlockLock;
-    ScopedPointer<AudioBuffer<float>> sample;
-    float * volumeValue;
+    SharedResourcePointer<ProcessorStateSampleCache> sampleCache;
+    ProcessorStateLoadedFile<ProcessorStateSampleCache::SamplePtr>* sampleFile;
+    int64 samplePosition{ 0 };   // audio thread only
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ProcessorstateAudioProcessor)
 };
@@ -10,182 +10,1587 @@
 
 #include "ProcessorState.h"
 
+constexpr int ProcessorState::maxSnapshotAttempts;
+
 ProcessorState::Parameter* ProcessorState::createAndAddParameter (const String& parameterID, const String& parameterName, const String& labelText,
     NormalisableRange<float> valueRange, float defaultValue, std::function<String (float)> valueToTextFunction,
     std::function<float (const String&)> textToValueFunction, bool isMetaParameter, bool isAutomatableParameter, bool isDiscrete)
 {
-#if ! JUCE_LINUX
-    jassert (MessageManager::getInstance()->isThisTheMessageThread());
-#endif
+#if ! JUCE_LINUX
+    jassert (MessageManager::getInstance()->isThisTheMessageThread());
+#endif
+
+    const int slot = bank.add(valueRange, defaultValue);
+    jassert(slot == parameters.size());
+
+    Parameter* p = new Parameter(*this, slot, parameterID, parameterName, labelText,
+        defaultValue, valueToTextFunction, textToValueFunction,
+        isMetaParameter, isAutomatableParameter,
+        isDiscrete);
+
+    // Parameter IDs must be unique, and so must their hashes: chunks store
+    // parameters by hash, so two IDs that collide can't be told apart.
+    jassert(getParameter(parameterID) == nullptr);
+    jassert(parameterIndex.find(hashID(parameterID), [](int) { return true; }) < 0);
+
+    processor.addParameter(p);
+
+    parameterIndex.add(hashID(parameterID), parameters.size());
+    parameterHashes.add(hashID(parameterID));
+    parameters.add(p);
+
+    // The new slot starts dirty so listeners pick up the initial value.
+    markParameterChanged();
+
+    // Reallocate the snapshot array, rounding it up to a whole number of
+    // cache lines so snapshot() never shares a line with anything else.
+    const size_t cacheLine = 64;
+    const size_t bytes = (parameters.size() * sizeof(float) + cacheLine - 1) & ~(cacheLine - 1);
+
+    snapshotStorage.calloc(bytes + cacheLine);
+    snapshotValues = reinterpret_cast<float*>((reinterpret_cast<pointer_sized_uint>(snapshotStorage.getData()) + cacheLine - 1) & ~(cacheLine - 1));
+
+    return p;
+}
+
+void ProcessorState::addData (Data* data)
+{
+    // Data IDs must be unique, and so must their hashes (see createAndAddParameter).
+    jassert(findDataPosition(data->getDataID()) < 0);
+    jassert(dataIndex.find(hashID(data->getDataID()), [](int) { return true; }) < 0);
+
+    dataIndex.add(hashID(data->getDataID()), dataItems.size());
+    dataItems.add(data);
+}
+
+int ProcessorState::findDataPosition (StringRef dataID) const noexcept
+{
+    return dataIndex.find(hashID(dataID), [this, dataID](int position)
+    {
+        return dataItems.getUnchecked(position)->getDataID() == dataID;
+    });
+}
+
+int ProcessorState::findParameterPosition (StringRef parameterID) const noexcept
+{
+    return parameterIndex.find(hashID(parameterID), [this, parameterID](int position)
+    {
+        return parameters.getUnchecked(position)->paramID == parameterID;
+    });
+}
+
+ProcessorState::Data* ProcessorState::getData (StringRef dataID) const noexcept
+{
+    const int i = findDataPosition(dataID);
+
+    if (i >= 0)
+        return dataItems.getUnchecked(i);
+
+    /* It's probably fatal if you can't find this item, all ProcessorState::Data
+     * objects should have been set up by now
+     */
+    jassertfalse;
+    return nullptr;
+}
+
+ProcessorState::Parameter* ProcessorState::getParameter (StringRef parameterID) const noexcept
+{
+    // When using this class, you must allow it to manage all the parameters
+    // in your AudioProcessor, and not add any parameter objects of other
+    // types!
+    jassert (processor.getParameters().size() == parameters.size());
+
+    const int i = findParameterPosition(parameterID);
+    return i >= 0 ? parameters.getUnchecked(i) : nullptr;
+}
+
+uint32 ProcessorState::hashID (StringRef id) noexcept
+{
+    uint32 hash = 2166136261u;
+
+    for (auto c = id.text.getAddress(); *c != 0; ++c)
+        hash = (hash ^ uint8(*c)) * 16777619u;
+
+    return hash;
+}
+
+std::atomic<float>* ProcessorState::getRawParameterValue (StringRef parameterID) const noexcept
+{
+    if (auto p = getParameter(parameterID))
+        return p->getRawValue();
+
+    return nullptr;
+}
+
+ValueTree ProcessorState::toValueTree () const
+{
+    Snapshot snapshot;
+    captureSnapshot(snapshot);
+
+    ValueTree root{ "state" };
+    auto parametersTree = root.getOrCreateChildWithName("parameters", nullptr);
+
+    forEachParameter([&parametersTree, &snapshot](int i, Parameter * p)
+    {
+        ValueTree child{ "PARAM" };
+        child.setProperty("id", p->paramID, nullptr);
+        child.setProperty("value", snapshot.values[i], nullptr);
+        parametersTree.addChild(child, -1, nullptr);
+    });
+
+    auto dataTree = root.getOrCreateChildWithName("data", nullptr);
+
+    for (int i = 0; i < dataItems.size(); ++i)
+    {
+        auto child = snapshot.data.getReference(i)->tree.createCopy();
+        child.setProperty("__id", dataItems.getUnchecked(i)->getDataID(), nullptr);
+        dataTree.addChild(child, -1, nullptr);
+    }
+
+    return root;
+}
+
+void ProcessorState::captureSnapshot (Snapshot& snapshot) const
+{
+    snapshot.values.malloc(parameters.size());
+    snapshot.data.resize(dataItems.size());
+
+    for (int attempt = 1;; ++attempt)
+    {
+        const uint32 generation = dataGeneration.load();
+
+        for (int i = 0; i < dataItems.size(); ++i)
+            snapshot.data.getReference(i) = dataItems.getUnchecked(i)->getEncoded();
+
+        bank.copyConsistentValues(snapshot.values);
+
+        if (dataGeneration.load() == generation || attempt == maxSnapshotAttempts)
+            return;
+    }
+}
+
+void ProcessorState::load (ValueTree root)
+{
+    bool anyApplied = false;
+
+    {
+        const ScopedLock sl(loadLock);
+        presetSequence = ++loadSequence;    // supersedes any loadAsync() still running
+
+        {
+            HeapBlock<float> values(parameters.size());
+            collectParameterValues(root, values);
+            anyApplied = applyParameterValues(values);
+        }
+
+        Array<ValueTree> trees;
+        collectDataTrees(root, trees);
+
+        for (int i = 0; i < dataItems.size(); ++i)
+        {
+            Data& d = *dataItems.getUnchecked(i);
+            const ValueTree& tree = trees.getReference(i);
+
+            if (tree.isValid() && isUnchanged(d, tree))
+                continue;
+
+            anyApplied = true;
+
+            if (lazyLoading)
+                deferDataItem(d, std::make_shared<DeferredData>(DeferredData{ tree, {}, 0, false }));
+            else
+                loadDataItem(d, tree);
+        }
+    }
+
+    // The history described the state before this preset.  A host handing
+    // back the state we already have leaves it alone.
+    if (anyApplied && undoHistory != nullptr)
+        undoHistory->clear();
+}
+
+void ProcessorState::collectParameterValues (const ValueTree& root, float* values) const
+{
+    const auto parametersTree = root.getChildWithName("parameters");
+    const int numParameters = parameters.size();
+
+    for (int i = 0; i < numParameters; ++i)
+        values[i] = parameters.getUnchecked(i)->defaultValue;    // getDefaultValue() is normalised
+
+    for (int c = 0; c < parametersTree.getNumChildren(); ++c)
+    {
+        const auto child = parametersTree.getChild(c);
+        const String id = child["id"];
+
+        // Presets saved by this version have the parameters in creation
+        // order, so try the same position before hashing the ID.
+        const int position = (c < numParameters && parameters.getUnchecked(c)->paramID == id)
+            ? c
+            : findParameterPosition(id);
+
+        if (position >= 0)
+            values[position] = child["value"];
+    }
+}
+
+void ProcessorState::collectDataTrees (const ValueTree& root, Array<ValueTree>& trees) const
+{
+    const auto dataTree = root.getChildWithName("data");
+    trees.clearQuick();
+    trees.resize(dataItems.size());
+
+    for (int c = 0; c < dataTree.getNumChildren(); ++c)
+    {
+        const auto child = dataTree.getChild(c);
+        const int position = findDataPosition(child["__id"].toString());
+
+        if (position >= 0 && ! trees.getReference(position).isValid())
+            trees.getReference(position) = child;
+    }
+}
+
+bool ProcessorState::isUnchanged (Data& d, const void* blob, size_t size, bool isCompressed)
+{
+    // Reads the item's encoding, which re-serialises it if it's changed
+    // since the last save.  That's cheap next to a deserialise.
+    const auto encoded = d.getEncoded();
+    const MemoryBlock& current = isCompressed ? encoded->compressed : encoded->data;
+
+    if (current.getSize() == size
+        && (isCompressed ? encoded->compressedHash : encoded->hash) == ProcessorStateChunk::hashContent(blob, size))
+    {
+        ++numDataSkipped;
+        return true;
+    }
+
+    ++numDataLoaded;
+    return false;
+}
+
+bool ProcessorState::isUnchanged (Data& d, const ValueTree& tree)
+{
+    MemoryOutputStream out;
+
+    // Trees from toValueTree() and presets carry the __id property, which the
+    // item's own encoding doesn't, so hash them without it.
+    if (tree.hasProperty("__id"))
+    {
+        ValueTree withoutId = tree.createCopy();
+        withoutId.removeProperty("__id", nullptr);
+        withoutId.writeToStream(out);
+    }
+    else
+    {
+        tree.writeToStream(out);
+    }
+
+    return isUnchanged(d, out.getData(), out.getDataSize(), false);
+}
+
+bool ProcessorState::applyParameterValues (const float* values)
+{
+    const int numParameters = parameters.size();
+    HeapBlock<float> current(numParameters);
+    bank.copyConsistentValues(current);
+
+    if (memcmp(current.getData(), values, sizeof(float) * size_t(numParameters)) == 0)
+    {
+        ++numParameterBlocksSkipped;
+        return false;
+    }
+
+    ++numParameterBlocksLoaded;
+    setMany(0, values, numParameters);
+    return true;
+}
+
+ProcessorState::LoadStatistics ProcessorState::getLoadStatistics () const noexcept
+{
+    return { numDataLoaded.load(), numDataSkipped.load(), numParameterBlocksLoaded.load(), numParameterBlocksSkipped.load() };
+}
+
+void ProcessorState::loadDataItem (Data& d, const ValueTree& tree)
+{
+    const ScopedLock sl(d.loadLock);
+
+    auto result = d.prepareToLoad(tree);
+    jassert(result);
+    d.preparedSequence = 0;
+
+    if (result)
+        d.commitLoad();
+}
+
+void ProcessorState::getStateInformation (MemoryBlock& destData) const
+{
+    destData = getCurrentBlob()->data;
+}
+
+void ProcessorState::writeChunk (MemoryBlock& destData) const
+{
+    Snapshot snapshot;
+    captureSnapshot(snapshot);
+
+    uint16 flags = 0;
+
+    for (const auto& encoded : snapshot.data)
+        if (encoded->compressed.getSize() > 0)
+            flags |= ProcessorStateChunk::compressedData;
+
+    ProcessorStateChunk::Writer writer(destData, parameters.size(), dataItems.size(), flags);
+    writer.writeParameters(parameterHashes.begin(), snapshot.values);
+
+    for (int i = 0; i < dataItems.size(); ++i)
+    {
+        const auto& encoded = snapshot.data.getReference(i);
+        const uint32 idHash = hashID(dataItems.getUnchecked(i)->getDataID());
+
+        if (encoded->compressed.getSize() > 0)
+            writer.writeData(idHash, encoded->generation, encoded->compressed.getData(), encoded->compressed.getSize(), encoded->data.getSize());
+        else
+            writer.writeData(idHash, encoded->generation, encoded->data.getData(), encoded->data.getSize());
+    }
+}
+
+void ProcessorState::setStateInformation (const void* data, int sizeInBytes)
+{
+    if (ProcessorStateChunk::isBinaryChunk(data, size_t(sizeInBytes)))
+    {
+        ProcessorStateChunk::Reader chunk;
+
+        // Asserts here?  The chunk is corrupt or from a newer version.
+        if (chunk.read(data, size_t(sizeInBytes)))
+            loadChunk(chunk);
+        else
+            jassertfalse;
+
+        return;
+    }
+
+    ScopedPointer<XmlElement> xmlState (AudioProcessor::getXmlFromBinary (data, sizeInBytes));
+
+    if (xmlState != nullptr)
+        if (xmlState->hasTagName ("state"))
+            load(ValueTree::fromXml (*xmlState));
+}
+
+void ProcessorState::loadChunk (const ProcessorStateChunk::Reader& chunk)
+{
+    bool anyApplied = false;
+
+    {
+        const ScopedLock sl(loadLock);
+        presetSequence = ++loadSequence;    // supersedes any loadAsync() still running
+
+        {
+            HeapBlock<float> values(parameters.size());
+            collectParameterValues(chunk, values);
+            anyApplied = applyParameterValues(values);
+        }
+
+        for (auto * d : dataItems)
+        {
+            auto entry = chunk.findData(hashID(d->getDataID()));
+
+            if (entry != nullptr && isUnchanged(*d, entry->blob, entry->size, entry->isCompressed()))
+                continue;
+
+            anyApplied = true;
+
+            // The chunk belongs to the host, so a deferred load copies the blob.
+            if (lazyLoading)
+                deferDataItem(*d, entry != nullptr
+                    ? std::make_shared<DeferredData>(DeferredData{ {}, MemoryBlock(entry->blob, entry->size), entry->uncompressedSize, true })
+                    : std::make_shared<DeferredData>(DeferredData{ {}, {}, 0, false }));
+            else
+                loadDataItem(*d, entry != nullptr
+                    ? readDataBlob(entry->blob, entry->size, entry->uncompressedSize)
+                    : ValueTree());
+        }
+    }
+
+    // The history described the state before this preset.  A host handing
+    // back the state we already have leaves it alone.
+    if (anyApplied && undoHistory != nullptr)
+        undoHistory->clear();
+}
+
+void ProcessorState::collectParameterValues (const ProcessorStateChunk::Reader& chunk, float* values) const
+{
+    const int numParameters = parameters.size();
+    const int numSaved = chunk.getNumParameters();
+
+    if (numSaved == numParameters
+        && memcmp(chunk.getParameterHashes(), parameterHashes.begin(), sizeof(uint32) * size_t(numParameters)) == 0)
+    {
+        // Saved by this version of the plugin: the values line up with the bank.
+        memcpy(values, chunk.getParameterValues(), sizeof(float) * size_t(numParameters));
+        return;
+    }
+
+    for (int i = 0; i < numParameters; ++i)
+        values[i] = parameters.getUnchecked(i)->defaultValue;    // getDefaultValue() is normalised
+
+    for (int i = 0; i < numSaved; ++i)
+    {
+        const int position = parameterIndex.find(chunk.getParameterHashes()[i], [](int) { return true; });
+
+        if (position >= 0)
+            values[position] = chunk.getParameterValues()[i];
+    }
+}
+
+ValueTree ProcessorState::readDataBlob (const void* blob, size_t size, size_t uncompressedSize)
+{
+    if (uncompressedSize == 0)
+        return ValueTree::readFromData(blob, size);
+
+    MemoryBlock inflated;
+
+    if (! ProcessorStateChunk::decompress(blob, size, uncompressedSize, inflated))
+    {
+        // Asserts here?  The compressed blob is corrupt.
+        jassertfalse;
+        return {};
+    }
+
+    return ValueTree::readFromData(inflated.getData(), inflated.getSize());
+}
+
+/*
+ * Asynchronous loading
+ */
+
+class ProcessorState::AsyncLoad
+{
+public:
+    /** A Data item's part of the preset.  Blobs from a chunk are copied and
+     * only parsed on the worker. */
+    struct Item
+    {
+        ValueTree tree;
+        MemoryBlock blob;
+        size_t uncompressedSize;
+        bool isBlob;
+        bool prepared;
+    };
+
+    /** Whether the item is part of this load.  A preset covers every item,
+     * but a morph switch only the ones its snapshot has. */
+    bool covers (const Item& item) const noexcept { return isPreset || item.isBlob || item.tree.isValid(); }
+
+    uint32 sequence{ 0 };
+    bool isPreset{ true };    // false for a morph switch, which leaves the parameters alone
+    HeapBlock<float> values;
+    Array<Item> items;
+    std::atomic<int> numRemaining{ 0 };
+    std::atomic<int> numDone{ 0 };
+    LoadCompletionCallback onComplete;
+    LoadProgressCallback onProgress;
+};
+
+class ProcessorState::LoadJob : public ThreadPoolJob
+{
+public:
+    LoadJob (ProcessorState& state, std::shared_ptr<AsyncLoad> load, int index)
+        : ThreadPoolJob("ProcessorState load"), state(state), load(std::move(load)), index(index)
+    {}
+
+    JobStatus runJob () override
+    {
+        auto& item = load->items.getReference(index);
+        Data& d = *state.dataItems.getUnchecked(index);
+
+        {
+            const ScopedLock sl(d.loadLock);
+
+            // Don't bother decoding anything for a load that's been replaced,
+            // that doesn't cover the item, or that the item already holds.
+            if (state.isCurrent(*load) && load->covers(item) && ! isUnchanged(d, item))
+            {
+                const ValueTree tree = item.isBlob
+                    ? readDataBlob(item.blob.getData(), item.blob.getSize(), item.uncompressedSize)
+                    : item.tree;
+
+                item.prepared = d.prepareToLoad(tree);
+                jassert(item.prepared);
+                d.preparedSequence = load->sequence;
+            }
+        }
+
+        const int numDone = ++load->numDone;
+
+        if (load->onProgress != nullptr)
+            load->onProgress(numDone, load->items.size());
+
+        if (--load->numRemaining == 0)
+            state.commitAsyncLoad(*load);
+
+        return jobHasFinished;
+    }
+
+    bool belongsTo (const ProcessorState& s) const noexcept { return &state == &s; }
+
+private:
+    bool isUnchanged (Data& d, const AsyncLoad::Item& item) const
+    {
+        if (item.isBlob)
+            return state.isUnchanged(d, item.blob.getData(), item.blob.getSize(), item.uncompressedSize != 0);
+
+        return item.tree.isValid() && state.isUnchanged(d, item.tree);
+    }
+
+    ProcessorState& state;
+    std::shared_ptr<AsyncLoad> load;
+    const int index;
+};
+
+void ProcessorState::loadAsync (ValueTree root, LoadCompletionCallback onComplete, LoadProgressCallback onProgress)
+{
+    auto load = std::make_shared<AsyncLoad>();
+    load->values.malloc(parameters.size());
+    collectParameterValues(root, load->values);
+
+    Array<ValueTree> trees;
+    collectDataTrees(root, trees);
+
+    for (const auto& tree : trees)
+        load->items.add({ tree, {}, 0, false, false });
+
+    load->onComplete = onComplete;
+    load->onProgress = onProgress;
+    startAsyncLoad(load);
+}
+
+void ProcessorState::setStateInformationAsync (const void* data, int sizeInBytes,
+    LoadCompletionCallback onComplete, LoadProgressCallback onProgress)
+{
+    if (ProcessorStateChunk::isBinaryChunk(data, size_t(sizeInBytes)))
+    {
+        ProcessorStateChunk::Reader chunk;
+
+        if (! chunk.read(data, size_t(sizeInBytes)))
+        {
+            // Asserts here?  The chunk is corrupt or from a newer version.
+            jassertfalse;
+
+            if (onComplete != nullptr)
+                onComplete(false);
+
+            return;
+        }
+
+        auto load = std::make_shared<AsyncLoad>();
+        load->values.malloc(parameters.size());
+        collectParameterValues(chunk, load->values);
+
+        // The chunk belongs to the host, so copy each blob out of it.
+        for (auto * d : dataItems)
+        {
+            if (auto entry = chunk.findData(hashID(d->getDataID())))
+                load->items.add({ {}, MemoryBlock(entry->blob, entry->size), entry->uncompressedSize, true, false });
+            else
+                load->items.add({ {}, {}, 0, false, false });
+        }
+
+        load->onComplete = onComplete;
+        load->onProgress = onProgress;
+        startAsyncLoad(load);
+        return;
+    }
+
+    ScopedPointer<XmlElement> xmlState (AudioProcessor::getXmlFromBinary (data, sizeInBytes));
+
+    if (xmlState != nullptr && xmlState->hasTagName ("state"))
+        loadAsync(ValueTree::fromXml (*xmlState), onComplete, onProgress);
+    else if (onComplete != nullptr)
+        onComplete(false);
+}
+
+void ProcessorState::startAsyncLoad (std::shared_ptr<AsyncLoad> load)
+{
+    {
+        // Under the lock, so a load that's being committed can't be
+        // superseded half way through.
+        const ScopedLock sl(loadLock);
+        load->sequence = ++loadSequence;
+        (load->isPreset ? presetSequence : morphSequence) = load->sequence;
+    }
+
+    for (int i = 0; i < load->items.size(); ++i)
+        if (load->covers(load->items.getReference(i)))
+            dataItems.getUnchecked(i)->discardPendingLoad();
+
+    load->numRemaining = load->items.size();
+
+    if (load->items.size() == 0)
+    {
+        commitAsyncLoad(*load);
+        return;
+    }
+
+    for (int i = 0; i < load->items.size(); ++i)
+        loadPool->pool.addJob(new LoadJob(*this, load, i), true);
+}
+
+void ProcessorState::commitAsyncLoad (AsyncLoad& load)
+{
+    bool committed = false;
+    bool anyApplied = false;
+
+    {
+        const ScopedLock sl(loadLock);
+
+        if (isCurrent(load))
+        {
+            if (load.isPreset)
+                anyApplied = applyParameterValues(load.values);
+
+            for (int i = 0; i < dataItems.size(); ++i)
+            {
+                if (! load.items.getReference(i).prepared)
+                    continue;
+
+                Data& d = *dataItems.getUnchecked(i);
+                const ScopedLock dataSl(d.loadLock);
+
+                // A synchronous load of the item since it was prepared has
+                // replaced what this load left pending.
+                if (d.preparedSequence == load.sequence)
+                {
+                    d.commitLoad();
+                    anyApplied = true;
+                }
+            }
+
+            committed = true;
+        }
+        else
+        {
+            // Superseded.  Free what was decoded for it, unless a later load
+            // has prepared the item since.
+            for (int i = 0; i < dataItems.size(); ++i)
+            {
+                if (! load.items.getReference(i).prepared)
+                    continue;
+
+                Data& d = *dataItems.getUnchecked(i);
+                const ScopedLock dataSl(d.loadLock);
+
+                if (d.preparedSequence == load.sequence)
+                    d.cancelLoad();
+            }
+        }
+    }
+
+    // A morph switch is part of the current state, not a new preset, so it
+    // keeps the history.
+    if (anyApplied && load.isPreset && undoHistory != nullptr)
+        undoHistory->clear();
+
+    if (load.onComplete != nullptr)
+        load.onComplete(committed);
+}
+
+bool ProcessorState::isCurrent (const AsyncLoad& load) const noexcept
+{
+    if (load.isPreset)
+        return load.sequence == presetSequence.load();
+
+    // A morph switch gives way to a newer one, and to any newer preset.
+    return load.sequence == morphSequence.load() && load.sequence > presetSequence.load();
+}
+
+/*
+ * Lazy loading
+ */
+
+class ProcessorState::DeferredLoaderThread : public Thread
+{
+public:
+    explicit DeferredLoaderThread (ProcessorState& state)
+        : Thread("ProcessorState deferred loader"), state(state)
+    {}
+
+    void run () override
+    {
+        bool anyWaiting = false;
+
+        while (! threadShouldExit())
+        {
+            // Asleep until a load is deferred; then polling, so requestLoad()
+            // doesn't have to wake us from the audio thread.
+            wait(anyWaiting ? pollIntervalMs : -1);
+
+            const double msSinceDefer = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - state.lastDeferTicks.load()) * 1000.0;
+            anyWaiting = state.applyDeferredLoads(msSinceDefer >= state.loadSettleTimeMs);
+        }
+    }
+
+private:
+    static constexpr int pollIntervalMs = 10;
+    ProcessorState& state;
+};
+
+void ProcessorState::setLazyLoading (bool shouldDefer, int settleTimeMs)
+{
+    lazyLoading = shouldDefer;
+    loadSettleTimeMs = jmax(0, settleTimeMs);
+}
+
+void ProcessorState::flushDeferredLoads ()
+{
+    applyDeferredLoads(true);
+}
+
+void ProcessorState::deferDataItem (Data& d, std::shared_ptr<const DeferredData> deferred)
+{
+    // Called with loadLock held.
+    if (! deferred->isBlob && ! deferred->tree.isValid())
+    {
+        // Not in the preset.  Going back to the default is cheap, and doing
+        // it now keeps the order of loads straightforward.
+        d.discardPendingLoad();
+        loadDataItem(d, {});
+        return;
+    }
+
+    // Replaces, and so discards, whatever was waiting.  The generation goes
+    // up after the store so that a save at the new generation encodes this.
+    std::atomic_store(&d.deferredLoad, deferred);
+    ++d.generation;
+    notifyChangedData();
+
+    lastDeferTicks = Time::getHighResolutionTicks();
+
+    if (deferredLoader == nullptr)
+    {
+        deferredLoader = new DeferredLoaderThread(*this);
+        deferredLoader->startThread();
+    }
+
+    deferredLoader->notify();
+}
+
+bool ProcessorState::applyDeferredLoads (bool settled)
+{
+    bool anyWaiting = false;
+
+    for (auto * d : dataItems)
+    {
+        if (! d->hasPendingLoad())
+            continue;
+
+        if (settled || d->loadRequested.load())
+            d->ensureLoaded();
+        else
+            anyWaiting = true;
+    }
+
+    return anyWaiting;
+}
+
+const float* ProcessorState::snapshot () noexcept
+{
+    noteAudioThread();
+    bank.copyValues(snapshotValues);
+    return snapshotValues;
+}
+
+void ProcessorState::setParameterAtSample (int parameterIndex, float newUnnormalisedValue, int sampleOffset) noexcept
+{
+    jassert(isPositiveAndBelow(parameterIndex, parameters.size()));
+
+    const float newValue = bank.getRange(parameterIndex).snapToLegalValue(newUnnormalisedValue);
+
+    noteAudioThread();
+
+    if (bank.setValue(parameterIndex, newValue))
+    {
+        events.push(parameterIndex, newValue, sampleOffset);
+        markParameterChanged();
+    }
+}
+
+void ProcessorState::setSmoothing (int parameterIndex, ProcessorStateSmoother::Type type, double timeSeconds)
+{
+    jassert(isPositiveAndBelow(parameterIndex, parameters.size()));
+    smoother.add(parameterIndex, type, timeSeconds);
+}
+
+void ProcessorState::prepareToPlay (double sampleRate, int maximumBlockSize)
+{
+    smoother.prepare(bank, sampleRate, maximumBlockSize);
+
+    // Processing is about to start, so watch for changes from the audio thread.
+    watchStartTicks = Time::getHighResolutionTicks();
+    startTimer(minimumDispatchIntervalMs);
+
+    if (morph != nullptr)
+        morph->prepare(sampleRate);
+}
+
+void ProcessorState::updateSmoothing (int numSamples) noexcept
+{
+    noteAudioThread();
+    smoother.process(bank, numSamples);
+}
+
+void ProcessorState::forEachParameter (std::function<void(int, Parameter*)> func) const
+{
+    const int numParams = parameters.size();
+
+    for (int i = 0; i < numParams; ++i)
+        func(i, parameters.getUnchecked(i));
+}
+
+void ProcessorState::IdIndex::add (uint32 hash, int position)
+{
+    // Keep the table at most half full so probe sequences stay short.
+    if ((numUsed + 1) * 2 > slots.size())
+    {
+        Array<Slot> old;
+        old.swapWith(slots);
+
+        slots.resize(jmax(16, old.size() * 2));
+
+        for (auto & slot : slots)
+            slot = { 0, -1 };
+
+        for (auto & slot : old)
+            if (slot.position >= 0)
+                insert(slot);
+    }
+
+    insert({ hash, position });
+    ++numUsed;
+}
+
+void ProcessorState::IdIndex::insert (Slot slot) noexcept
+{
+    const int mask = slots.size() - 1;
+    int i = int(slot.hash) & mask;
+
+    while (slots.getReference(i).position >= 0)
+        i = (i + 1) & mask;
+
+    slots.getReference(i) = slot;
+}
+
+void ProcessorState::setMaximumRefreshRate (int hz)
+{
+    jassert(hz > 0);
+    minimumDispatchIntervalMs = 1000 / jmax(1, hz);
+}
+
+ProcessorState::NotificationStatistics ProcessorState::getNotificationStatistics () const noexcept
+{
+    return statistics;
+}
+
+void ProcessorState::resetNotificationStatistics () noexcept
+{
+    statistics = { 0, 0, 0.0, 0.0, 0.0 };
+}
+
+ProcessorState::Batch ProcessorState::beginBatch ()
+{
+    return Batch(*this);
+}
+
+void ProcessorState::setMany (int firstParameterIndex, const float* unnormalisedValues, int numValues)
+{
+    jassert(firstParameterIndex >= 0 && firstParameterIndex + numValues <= parameters.size());
+
+    bool anyChanged = false;
+
+    for (int i = 0; i < numValues; ++i)
+        anyChanged |= applyWithoutNotifyingHost(firstParameterIndex + i, unnormalisedValues[i]);
+
+    finishBatch(anyChanged);
+}
+
+bool ProcessorState::applyWithoutNotifyingHost (int parameterIndex, float newUnnormalisedValue)
+{
+    Parameter* p = parameters[parameterIndex];
+    jassert(p != nullptr);
+
+    if (p->isInGesture())
+    {
+        // The host is recording the user's edit, so it has to see this one.
+        p->setUnnormalisedValue(newUnnormalisedValue);
+        return false;
+    }
+
+    const float newValue = bank.getRange(parameterIndex).snapToLegalValue(newUnnormalisedValue);
+
+    if (! bank.setValue(parameterIndex, newValue))
+        return false;
+
+    events.push(parameterIndex, newValue);
+    return true;
+}
+
+void ProcessorState::finishBatch (bool anyChanged)
+{
+    if (anyChanged)
+    {
+        markParameterChanged();
+        processor.updateHostDisplay();
+    }
+}
+
+/*
+ * Batch
+ */
+
+ProcessorState::Batch::Batch (Batch&& other) noexcept
+    : state(other.state), changes(std::move(other.changes))
+{
+    other.state = nullptr;
+}
+
+ProcessorState::Batch::~Batch ()
+{
+    if (state != nullptr)
+        commit();
+}
+
+void ProcessorState::Batch::set (int parameterIndex, float newUnnormalisedValue)
+{
+    jassert(isPositiveAndBelow(parameterIndex, state->getNumParameters()));
+    changes.add({ parameterIndex, newUnnormalisedValue });
+}
+
+void ProcessorState::Batch::set (Parameter& parameter, float newUnnormalisedValue)
+{
+    jassert(&parameter.state == state);
+    changes.add({ parameter.slot, newUnnormalisedValue });
+}
+
+void ProcessorState::Batch::commit ()
+{
+    bool anyChanged = false;
+
+    for (const auto& change : changes)
+        anyChanged |= state->applyWithoutNotifyingHost(change.parameterIndex, change.value);
+
+    changes.clearQuick();
+    state->finishBatch(anyChanged);
+}
+
+void ProcessorState::noteAudioThread () noexcept
+{
+    audioThread.store(Thread::getCurrentThreadId(), std::memory_order_relaxed);
+    numAudioCalls.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*
+ * Undo
+ */
+
+void ProcessorState::enableUndo (int maximumSteps, size_t maximumBytes)
+{
+    jassert(undoHistory == nullptr);
+    undoHistory = new UndoHistory(*this, maximumSteps, maximumBytes);
+}
+
+ProcessorState::UndoHistory::UndoHistory (ProcessorState& state, int maximumSteps, size_t maximumBytes)
+    : state(state), maximumSteps(maximumSteps), maximumBytes(maximumBytes)
+{
+    state.captureSnapshot(baseline);
+}
 
-    Parameter* p = new Parameter(parameterID, parameterName, labelText, valueRange,
-        defaultValue, valueToTextFunction, textToValueFunction,
-        isMetaParameter, isAutomatableParameter,
-        isDiscrete);
-    processor.addParameter(p);
-    return p;
+bool ProcessorState::UndoHistory::checkpoint ()
+{
+    const ScopedLock sl(lock);
+    return recordStep();
 }
 
-void ProcessorState::addData (Data* data)
+bool ProcessorState::UndoHistory::recordStep ()
 {
-    dataItems.add(data);
+    if (state.numGestures.load() > 0)
+        return false;
+
+    Snapshot current;
+    state.captureSnapshot(current);
+
+    std::unique_ptr<Step> step(new Step());
+
+    for (int i = 0; i < state.parameters.size(); ++i)
+        if (current.values[i] != baseline.values[i])
+            step->parameters.add({ i, baseline.values[i], current.values[i] });
+
+    // Unchanged items share their encoding with the baseline, so most are
+    // skipped on the pointer.
+    for (int i = 0; i < state.dataItems.size(); ++i)
+    {
+        const auto& before = baseline.data.getReference(i);
+        const auto& after = current.data.getReference(i);
+
+        if (before != after && (before->hash != after->hash || before->data != after->data))
+            step->data.add(diff(i, before->data, after->data));
+    }
+
+    baseline.values.swapWith(current.values);
+    baseline.data.swapWith(current.data);
+
+    if (step->parameters.isEmpty() && step->data.isEmpty())
+        return false;
+
+    step->bytes = sizeof(Step) + size_t(step->parameters.size()) * sizeof(ParameterChange);
+
+    for (const auto& change : step->data)
+        step->bytes += sizeof(DataChange) + change.before.getSize() + change.after.getSize();
+
+    // A new step replaces anything that could have been redone.
+    while (steps.size() > position)
+    {
+        totalBytes -= steps.getLast()->bytes;
+        steps.removeLast();
+    }
+
+    totalBytes += step->bytes;
+    steps.add(step.release());
+    position = steps.size();
+    trimToLimits();
+    return true;
 }
 
-ProcessorState::Data* ProcessorState::getData (StringRef dataID) const noexcept
+ProcessorState::UndoHistory::DataChange ProcessorState::UndoHistory::diff (int index, const MemoryBlock& before, const MemoryBlock& after)
 {
-    for (auto & item: dataItems)
-        if (item->getDataID() == dataID)
-            return item;
+    auto b = static_cast<const uint8*>(before.getData());
+    auto a = static_cast<const uint8*>(after.getData());
+    const size_t shorter = jmin(before.getSize(), after.getSize());
 
-    /* It's probably fatal if you can't find this item, all ProcessorState::Data
-     * objects should have been set up by now
-     */
-    jassertfalse;
-    return nullptr;
+    size_t prefix = 0;
+
+    while (prefix < shorter && b[prefix] == a[prefix])
+        ++prefix;
+
+    size_t suffix = 0;
+
+    while (suffix < shorter - prefix && b[before.getSize() - 1 - suffix] == a[after.getSize() - 1 - suffix])
+        ++suffix;
+
+    return { index, prefix, suffix,
+             MemoryBlock(b + prefix, before.getSize() - prefix - suffix),
+             MemoryBlock(a + prefix, after.getSize() - prefix - suffix) };
 }
 
-ProcessorState::Parameter* ProcessorState::getParameter (StringRef parameterID) const noexcept
+bool ProcessorState::UndoHistory::undo ()
 {
-    const int numParams = processor.getParameters().size();
+    const ScopedLock sl(lock);
 
-    for (int i = 0; i < numParams; ++i)
+    // Unrecorded changes are the first thing to undo.
+    recordStep();
+
+    if (position == 0)
+        return false;
+
+    apply(*steps.getUnchecked(--position), true);
+    return true;
+}
+
+bool ProcessorState::UndoHistory::redo ()
+{
+    const ScopedLock sl(lock);
+
+    if (position == steps.size())
+        return false;
+
+    apply(*steps.getUnchecked(position++), false);
+    return true;
+}
+
+void ProcessorState::UndoHistory::apply (const Step& step, bool backwards)
+{
     {
-        AudioProcessorParameter* const ap = processor.getParameters().getUnchecked(i);
+        const ScopedLock loadSl(state.loadLock);
+        state.presetSequence = ++state.loadSequence;    // supersedes any loadAsync() still running
+
+        auto batch = state.beginBatch();
+
+        for (const auto& change : step.parameters)
+            batch.set(change.index, backwards ? change.before : change.after);
+
+        batch.commit();
 
-        // When using this class, you must allow it to manage all the parameters
-        // in your AudioProcessor, and not add any parameter objects of other
-        // types!
-        jassert (dynamic_cast<Parameter*> (ap) != nullptr);
+        for (const auto& change : step.data)
+        {
+            Data& d = *state.dataItems.getUnchecked(change.index);
+            const MemoryBlock& from = backwards ? change.after : change.before;
+            const MemoryBlock& to = backwards ? change.before : change.after;
+
+            // The item should hold what the step left it with.  If it
+            // doesn't, something changed it without a checkpoint.
+            const auto current = d.getEncoded();
+            const size_t currentSize = current->data.getSize();
+
+            if (currentSize != change.prefix + from.getSize() + change.suffix)
+            {
+                jassertfalse;
+                continue;
+            }
 
-        Parameter* const p = static_cast<Parameter*>(ap);
+            MemoryBlock target(current->data.getData(), change.prefix);
+            target.append(to.getData(), to.getSize());
+            target.append(static_cast<const char*>(current->data.getData()) + currentSize - change.suffix, change.suffix);
 
-        if (parameterID == p->paramID)
-            return p;
+            d.discardPendingLoad();
+            loadDataItem(d, ValueTree::readFromData(target.getData(), target.getSize()));
+        }
     }
 
-    return nullptr;
+    // The state now matches the other side of the step.
+    state.captureSnapshot(baseline);
 }
 
-float* ProcessorState::getRawParameterValue (StringRef parameterID) const noexcept
+void ProcessorState::UndoHistory::trimToLimits ()
 {
-    if (auto p = getParameter(parameterID))
-        return &p->value;
+    while (steps.size() > 0 && (steps.size() > maximumSteps || totalBytes > maximumBytes))
+    {
+        // The oldest undo step goes first.  If everything has been undone,
+        // the furthest redo step goes instead, as the others lead up to it.
+        const int index = position > 0 ? 0 : steps.size() - 1;
+        totalBytes -= steps.getUnchecked(index)->bytes;
+        steps.remove(index);
 
-    return nullptr;
+        if (position > 0)
+            --position;
+
+        ++numDiscarded;
+    }
 }
 
-ValueTree ProcessorState::toValueTree () const
+bool ProcessorState::UndoHistory::canUndo () const
 {
-    ValueTree root{ "state" };
-    auto parametersTree = root.getOrCreateChildWithName("parameters", nullptr);
+    const ScopedLock sl(lock);
+    return position > 0;
+}
+
+bool ProcessorState::UndoHistory::canRedo () const
+{
+    const ScopedLock sl(lock);
+    return position < steps.size();
+}
+
+void ProcessorState::UndoHistory::clear ()
+{
+    const ScopedLock sl(lock);
+    steps.clear();
+    position = 0;
+    totalBytes = 0;
+    state.captureSnapshot(baseline);
+}
+
+void ProcessorState::UndoHistory::setLimits (int newMaximumSteps, size_t newMaximumBytes)
+{
+    const ScopedLock sl(lock);
+    maximumSteps = jmax(1, newMaximumSteps);
+    maximumBytes = newMaximumBytes;
+    trimToLimits();
+}
+
+ProcessorState::UndoHistory::Statistics ProcessorState::UndoHistory::getStatistics () const
+{
+    const ScopedLock sl(lock);
+    return { position, steps.size() - position, totalBytes, numDiscarded };
+}
+
+/*
+ * Morphing
+ */
+
+void ProcessorState::enableMorph (int numSnapshots)
+{
+    jassert(morph == nullptr && numSnapshots > 0);
+
+    Array<bool> discrete;
+
+    for (auto * p : parameters)
+        discrete.add(p->isDiscrete());
+
+    morph = new ProcessorStateMorph(reclaimer);
+    morph->setSize(numSnapshots, parameters.size(), discrete);
+    morphValues.calloc(size_t(parameters.size()));
+    morphDirty.setSize(parameters.size());
+
+    for (int n = 0; n < numSnapshots; ++n)
+        morphData.add(Array<ValueTree>());
+}
+
+void ProcessorState::setMorphSnapshot (int index)
+{
+    jassert(morph != nullptr && isPositiveAndBelow(index, morph->getNumSnapshots()));
+
+    Snapshot current;
+    captureSnapshot(current);
+
+    Array<ValueTree> trees;
+
+    for (const auto& encoded : current.data)
+        trees.add(encoded->tree);
 
-    forEachParameter([&parametersTree](int, Parameter * p)
     {
-        ValueTree child{ "PARAM" };
-        child.setProperty("id", p->paramID, nullptr);
-        child.setProperty("value", p->value, nullptr);
-        parametersTree.addChild(child, -1, nullptr);
-    });
+        const ScopedLock sl(morphLock);
+        morphData.getReference(index).swapWith(trees);
+    }
 
-    auto dataTree = root.getOrCreateChildWithName("data", nullptr);
+    morph->setSnapshot(index, current.values);
+}
+
+void ProcessorState::setMorphSnapshot (int index, const ValueTree& preset)
+{
+    jassert(morph != nullptr && isPositiveAndBelow(index, morph->getNumSnapshots()));
+
+    HeapBlock<float> values(parameters.size());
+    collectParameterValues(preset, values);
+
+    Array<ValueTree> trees;
+    collectDataTrees(preset, trees);
 
-    for (auto * d : dataItems)
     {
-        auto child = d->serialize();
-        child.setProperty("__id", d->getDataID(), nullptr);
-        dataTree.addChild(child, -1, nullptr);
+        const ScopedLock sl(morphLock);
+        morphData.getReference(index).swapWith(trees);
     }
 
-    DBG(root.toXmlString());
+    morph->setSnapshot(index, values);
+}
+
+void ProcessorState::setMorphWeights (const float* weights, int numWeights) noexcept
+{
+    jassert(morph != nullptr);
+    morph->setWeights(weights, numWeights);
+}
 
-    return root;
+void ProcessorState::setMorphGlideTime (double seconds) noexcept
+{
+    jassert(morph != nullptr);
+    morph->setGlideTime(seconds);
 }
 
-void ProcessorState::load (ValueTree root) const
+void ProcessorState::processMorph (int numSamples) noexcept
 {
+    noteAudioThread();
+
+    int heaviest = -1;
+
+    if (morph == nullptr || ! morph->process(numSamples, morphValues, heaviest))
+        return;
+
+    bool anyChanged = false;
+
+    for (int i = 0; i < parameters.size(); ++i)
     {
-        auto parametersTree = root.getOrCreateChildWithName("parameters", nullptr);
+        // The user's drag wins over the morph.
+        if (parameters.getUnchecked(i)->isInGesture())
+            continue;
+
+        const float newValue = bank.getRange(i).snapToLegalValue(morphValues[i]);
 
-        forEachParameter([parametersTree](int, Parameter * p)
+        if (bank.setValue(i, newValue))
         {
-            auto child = parametersTree.getChildWithProperty("id", p->paramID);
+            events.push(i, newValue);
+            morphDirty.set(i);
+            anyChanged = true;
+        }
+    }
 
-            if (child.isValid())
-                p->setUnnormalisedValue(child["value"]);
-            else
-                p->setUnnormalisedValue(p->getDefaultValue());
-        });
+    if (morphDataTarget.exchange(heaviest) != heaviest)
+        anyChanged = true;
+
+    // Wakes the message thread, at most once per refresh interval, to tell
+    // the host and switch the Data items.
+    if (anyChanged)
+        markParameterChanged();
+}
+
+void ProcessorState::dispatchMorphChanges ()
+{
+    // The parameters were added to the processor in slot order, so the
+    // slot is also the processor's parameter index.
+    morphDirty.take([this](int slot)
+    {
+        processor.sendParamChangeMessageToListeners(slot, parameters.getUnchecked(slot)->getValue());
+    });
+
+    const int target = morphDataTarget.load();
+
+    if (target < 0 || target == morphDataApplied)
+        return;
+
+    morphDataApplied = target;
+
+    Array<ValueTree> trees;
+
+    {
+        const ScopedLock sl(morphLock);
+        trees = morphData.getReference(target);
     }
 
+    // Items the snapshot doesn't cover, or that already match it, are left.
+    if (lazyLoading)
     {
-        auto dataTree = root.getOrCreateChildWithName("data", nullptr);
+        const ScopedLock sl(loadLock);
 
-        for (auto * d : dataItems)
+        for (int i = 0; i < jmin(trees.size(), dataItems.size()); ++i)
         {
-            auto child = dataTree.getChildWithProperty("__id", d->getDataID());
+            Data& d = *dataItems.getUnchecked(i);
+            const ValueTree& tree = trees.getReference(i);
 
-            if (!child.isValid())
-            {
-                d->setToDefaultState();
-            }
-            else
+            if (tree.isValid() && ! isUnchanged(d, tree))
+                deferDataItem(d, std::make_shared<DeferredData>(DeferredData{ tree, {}, 0, false }));
+        }
+
+        return;
+    }
+
+    // Decoding a sample here would hold up the message thread, so the items
+    // are prepared on the load pool and switched together once they're ready.
+    auto load = std::make_shared<AsyncLoad>();
+    load->isPreset = false;
+
+    for (int i = 0; i < dataItems.size(); ++i)
+        load->items.add({ i < trees.size() ? trees.getReference(i) : ValueTree(), {}, 0, false, false });
+
+    startAsyncLoad(load);
+}
+
+/*
+ * State blob cache
+ */
+
+class ProcessorState::BlobWriterThread : public Thread
+{
+public:
+    explicit BlobWriterThread (const ProcessorState& state)
+        : Thread("ProcessorState blob writer"), state(state)
+    {}
+
+    void run () override
+    {
+        while (! threadShouldExit())
+        {
+            // Asleep until notifyBlobWriter() says something changed.
+            state.blobChanged.wait(-1);
+
+            // Then wait for a whole interval without changes, so a preset
+            // load or a fader move is encoded once rather than on every step.
+            uint32 lastGeneration = state.stateGeneration.load();
+
+            while (! threadShouldExit())
             {
-                auto result = d->deserialize(child);
-                jassert(result);
-                (void)result; // some future global error handling
+                wait(settleTimeMs);
+
+                const uint32 generation = state.stateGeneration.load();
+
+                if (generation == lastGeneration)
+                    break;
+
+                lastGeneration = generation;
             }
+
+            if (! threadShouldExit() && state.isBlobStale())
+                state.getCurrentBlob();
         }
     }
-}
 
-void ProcessorState::getStateInformation (MemoryBlock& destData) const
+private:
+    static constexpr int settleTimeMs = 250;
+    const ProcessorState& state;
+};
+
+ProcessorState::~ProcessorState ()
 {
-    ScopedPointer<XmlElement> xml (toValueTree().createXml());
-    AudioProcessor::copyXmlToBinary (*xml, destData);
+    if (deferredLoader != nullptr)
+        deferredLoader->stopThread(2000);
+
+    // The pool is shared, so remove only our loadAsync() jobs, and wait for
+    // any that are running, as they use the Data items.
+    struct OwnJobs : public ThreadPool::JobSelector
+    {
+        explicit OwnJobs (const ProcessorState& state) : state(state) {}
+
+        bool isJobSuitable (ThreadPoolJob* job) override
+        {
+            auto loadJob = dynamic_cast<LoadJob*>(job);
+            return loadJob != nullptr && loadJob->belongsTo(state);
+        }
+
+        const ProcessorState& state;
+    };
+
+    OwnJobs ownJobs(*this);
+    const bool removed = loadPool->pool.removeAllJobs(false, 10000, &ownJobs);
+    jassert(removed);
+    ignoreUnused(removed);
+
+    if (blobWriter != nullptr)
+    {
+        blobWriter->signalThreadShouldExit();
+        blobChanged.signal();
+        blobWriter->stopThread(2000);
+    }
 }
 
-void ProcessorState::setStateInformation (const void* data, int sizeInBytes)
+void ProcessorState::notifyChangedData ()
 {
-    ScopedPointer<XmlElement> xmlState (AudioProcessor::getXmlFromBinary (data, sizeInBytes));
+    ++dataGeneration;
+    ++stateGeneration;
+    blobChanged.signal();
+    processor.updateHostDisplay();
+}
 
-    if (xmlState != nullptr)
-        if (xmlState->hasTagName ("state"))
-            load(ValueTree::fromXml (*xmlState));
+bool ProcessorState::isBlobStale () const
+{
+    auto blob = std::atomic_load(&cachedBlob);
+    return blob == nullptr || blob->generation != stateGeneration.load();
 }
 
-void ProcessorState::forEachParameter (std::function<void(int, Parameter*)> func) const
+std::shared_ptr<const ProcessorState::StateBlob> ProcessorState::getCurrentBlob () const
 {
-    const int numParams = processor.getParameters().size();
+    auto blob = std::atomic_load(&cachedBlob);
 
-    for (int i = 0; i < numParams; ++i)
+    if (blob != nullptr && blob->generation == stateGeneration.load())
+        return blob;
+
+    const ScopedLock sl(blobLock);
+
+    // The first request for the state means construction is over and every
+    // parameter and Data item exists, so the background writer can start.
+    if (blobWriter == nullptr)
     {
-        AudioProcessorParameter* const ap = processor.getParameters().getUnchecked(i);
-        jassert (dynamic_cast<Parameter*> (ap) != nullptr);
+        blobWriter = new BlobWriterThread(*this);
+        blobWriter->startThread(2);
+    }
+
+    // Read the generation before encoding.  Anything that changes while
+    // we're encoding bumps it again and the blob is simply stale next time.
+    const uint32 generation = stateGeneration.load();
+    blob = std::atomic_load(&cachedBlob);
+
+    if (blob != nullptr && blob->generation == generation)
+        return blob;
+
+    std::shared_ptr<StateBlob> newBlob = std::make_shared<StateBlob>();
+    newBlob->generation = generation;
+    writeChunk(newBlob->data);
+
+    blob = newBlob;
+    std::atomic_store(&cachedBlob, blob);
+    return blob;
+}
+
+void ProcessorState::markParameterChanged () noexcept
+{
+    ++stateGeneration;
+
+    if (! dispatchPending.exchange(true))
+        firstChangeTicks.store(Time::getHighResolutionTicks(), std::memory_order_relaxed);
+
+    // Posting a message can allocate or block, so changes made on the audio
+    // thread are left for the timer.
+    if (Thread::getCurrentThreadId() != audioThread.load(std::memory_order_relaxed)
+        && ! dispatchScheduled.exchange(true))
+        triggerAsyncUpdate();
+}
 
-        Parameter* p = static_cast<Parameter*>(ap);
+void ProcessorState::handleAsyncUpdate ()
+{
+    const double msSinceLastDispatch = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - lastDispatchTicks) * 1000.0;
 
-        func(i, p);
+    if (msSinceLastDispatch < minimumDispatchIntervalMs)
+    {
+        // Too soon after the last one; the timer delivers it when the
+        // interval is up.
+        startTimer(jmax(1, minimumDispatchIntervalMs - int(msSinceLastDispatch)));
+        return;
     }
 
+    dispatchParameterChanges();
+
+    // The host may have started processing again without calling
+    // prepareToPlay(), so look for audio thread changes again.
+    if (! isTimerRunning() && numAudioCalls.load(std::memory_order_relaxed) != lastNumAudioCalls)
+    {
+        watchStartTicks = lastDispatchTicks;
+        startTimer(minimumDispatchIntervalMs);
+    }
 }
 
 void ProcessorState::timerCallback ()
 {
-    bool anythingUpdated = false;
+    const int64 now = Time::getHighResolutionTicks();
+    const uint32 numCalls = numAudioCalls.load(std::memory_order_relaxed);
 
-    forEachParameter([&](int, Parameter * p)
+    if (numCalls != lastNumAudioCalls)
     {
-        int expected = 1;
+        lastNumAudioCalls = numCalls;
+        lastAudioTicks = now;
+    }
 
-        if (p->needsUpdate.compare_exchange_weak(expected, 0, std::memory_order_acquire))
-        {
-            p->callMessageThreadListeners();
-            anythingUpdated = true;
-        }
+    const double msSinceAudio = Time::highResolutionTicksToSeconds(now - jmax(lastAudioTicks, watchStartTicks.load())) * 1000.0;
+    const bool audioRunning = msSinceAudio < audioQuietMs;
+
+    if (dispatchPending.load())
+    {
+        dispatchParameterChanges();
+
+        if (! audioRunning)
+            stopTimer();
+        else if (getTimerInterval() != minimumDispatchIntervalMs)
+            startTimer(minimumDispatchIntervalMs);
+
+        return;
+    }
+
+    ++statistics.numEmptyDispatches;
+
+    // Nothing has changed.  Back off while the audio thread is running, and
+    // stop once it has gone quiet.
+    if (audioRunning)
+        startTimer(jmin(maximumPollIntervalMs, getTimerInterval() * 2));
+    else
+        stopTimer();
+}
+
+void ProcessorState::dispatchParameterChanges ()
+{
+    jassert(MessageManager::getInstance()->isThisTheMessageThread());
+
+    // Clear the flags first, so anything marked from here on wakes us again
+    // rather than being missed.
+    dispatchPending.store(false);
+    dispatchScheduled.store(false);
+
+    const int64 now = Time::getHighResolutionTicks();
+    const double latencyMs = Time::highResolutionTicksToSeconds(now - firstChangeTicks.load(std::memory_order_relaxed)) * 1000.0;
+
+    const bool anythingUpdated = bank.takeDirty([this](int slot)
+    {
+        parameters.getUnchecked(slot)->callMessageThreadListeners();
     });
 
-    startTimer(anythingUpdated ? 1000 / 50
-        : jlimit(50, 500, getTimerInterval() + 20));
+    if (morph != nullptr)
+        dispatchMorphChanges();
+
+    lastDispatchTicks = now;
+
+    // markParameterChanged() can't wake the blob writer from the audio
+    // thread, so it's woken here instead.
+    blobChanged.signal();
+
+    if (! anythingUpdated)
+    {
+        ++statistics.numEmptyDispatches;
+        return;
+    }
+
+    ++statistics.numDispatches;
+    statistics.lastLatencyMs = latencyMs;
+    statistics.maxLatencyMs = jmax(statistics.maxLatencyMs, latencyMs);
+    statistics.meanLatencyMs += (latencyMs - statistics.meanLatencyMs) / double(statistics.numDispatches);
 }
 
 ProcessorState::Parameter::~Parameter ()
@@ -196,16 +1601,18 @@ ProcessorState::Parameter::~Parameter ()
 
 float ProcessorState::Parameter::getValue () const
 {
-    return range.convertTo0to1(value);
+    return state.bank.getNormalisedValue(slot);
 }
 
 float ProcessorState::Parameter::getDefaultValue () const
 {
-    return range.convertTo0to1(defaultValue);
+    return getRange().convertTo0to1(defaultValue);
 }
 
 int ProcessorState::Parameter::getNumSteps () const
 {
+    const auto range = getRange();
+
     if (range.interval > 0)
         return static_cast<int>((range.end - range.start) / range.interval) + 1;
 
@@ -214,24 +1621,48 @@ int ProcessorState::Parameter::getNumSteps () const
 
 void ProcessorState::Parameter::setValue (float newValue)
 {
+    const auto range = getRange();
     newValue = range.snapToLegalValue(range.convertFrom0to1(newValue));
 
-    if (value != newValue)
+    if (state.bank.setValue(slot, newValue))
     {
-        value = newValue;
-        needsUpdate.store(1, std::memory_order_release);
+        state.events.push(slot, newValue);
+        state.markParameterChanged();
     }
 }
 
 void ProcessorState::Parameter::setUnnormalisedValue (float newUnnormalisedValue)
 {
-    if (value != newUnnormalisedValue)
+    if (getUnnormalisedValue() != newUnnormalisedValue)
     {
-        const float newValue = range.convertTo0to1(newUnnormalisedValue);
+        const float newValue = getRange().convertTo0to1(newUnnormalisedValue);
         setValueNotifyingHost(newValue);
     }
 }
 
+void ProcessorState::Parameter::beginGesture ()
+{
+    if (gestureDepth++ == 0)
+    {
+        ++state.numGestures;
+        beginChangeGesture();
+    }
+}
+
+void ProcessorState::Parameter::endGesture ()
+{
+    jassert(gestureDepth.load() > 0);
+
+    if (--gestureDepth == 0)
+    {
+        endChangeGesture();
+
+        // A drag is one undo step, however many values it went through.
+        if (--state.numGestures == 0 && state.undoHistory != nullptr)
+            state.undoHistory->checkpoint();
+    }
+}
+
 bool ProcessorState::Parameter::isMetaParameter () const
 {
     return isMetaParam;
@@ -264,7 +1695,7 @@ void ProcessorState::Parameter::removeListener (Listener* l)
 void ProcessorState::Parameter::callMessageThreadListeners ()
 {
     jassert(MessageManager::getInstance()->isThisTheMessageThread());
-    listeners.call(&Listener::parameterChanged, paramID, value);
+    listeners.call(&Listener::parameterChanged, paramID, getUnnormalisedValue());
 }
 
 void ProcessorState::Data::notifyChanged (NotificationType notifyMessageThreadListeners)
@@ -272,9 +1703,69 @@ void ProcessorState::Data::notifyChanged (NotificationType notifyMessageThreadLi
     if (notifyMessageThreadListeners != dontSendNotification)
         triggerAsyncUpdate();
 
+    ++generation;
     state.notifyChangedData();
 }
 
+std::shared_ptr<const ProcessorState::EncodedData> ProcessorState::Data::getEncoded ()
+{
+    auto encoded = std::atomic_load(&cachedEncoding);
+
+    if (encoded != nullptr && encoded->generation == generation.load())
+        return encoded;
+
+    const ScopedLock sl(encodeLock);
+
+    // As with the state blob, read the generation before serialising so a
+    // change made part way through leaves the cache stale rather than wrong.
+    const uint32 currentGeneration = generation.load();
+    encoded = std::atomic_load(&cachedEncoding);
+
+    if (encoded != nullptr && encoded->generation == currentGeneration)
+        return encoded;
+
+    std::shared_ptr<EncodedData> newEncoding = std::make_shared<EncodedData>();
+    newEncoding->generation = currentGeneration;
+
+    // A lazy load that hasn't been applied yet is what the item will hold,
+    // so save that rather than the old data.
+    auto deferred = std::atomic_load(&deferredLoad);
+    newEncoding->tree = deferred != nullptr ? deferred->getTree() : serialize();
+
+    {
+        MemoryOutputStream out(newEncoding->data, false);
+        newEncoding->tree.writeToStream(out);
+    }
+
+    if (compress && newEncoding->data.getSize() >= compressionThreshold)
+        ProcessorStateChunk::compress(newEncoding->data.getData(), newEncoding->data.getSize(), newEncoding->compressed);
+
+    newEncoding->hash = ProcessorStateChunk::hashContent(newEncoding->data.getData(), newEncoding->data.getSize());
+    newEncoding->compressedHash = newEncoding->compressed.getSize() > 0
+        ? ProcessorStateChunk::hashContent(newEncoding->compressed.getData(), newEncoding->compressed.getSize())
+        : 0;
+
+    encoded = newEncoding;
+    std::atomic_store(&cachedEncoding, encoded);
+    return encoded;
+}
+
+void ProcessorState::Data::ensureLoaded ()
+{
+    if (! hasPendingLoad())
+        return;
+
+    const ScopedLock sl(loadLock);
+
+    // Taken under the lock, so a load deferred while this one is applied
+    // waits for the next call.
+    auto deferred = std::atomic_exchange(&deferredLoad, std::shared_ptr<const DeferredData>());
+    loadRequested = false;
+
+    if (deferred != nullptr)
+        ProcessorState::loadDataItem(*this, deferred->getTree());
+}
+
 void ProcessorState::Data::handleAsyncUpdate ()
 {
     listeners.call(&Listener::processorStateDataChanged, dataID);
@@ -282,23 +1773,22 @@ void ProcessorState::Data::handleAsyncUpdate ()
 
 float ProcessorState::Parameter::getValueForText (const String& text) const
 {
-    return range.convertTo0to1(textToValueFunction != nullptr ? textToValueFunction(text)
+    return getRange().convertTo0to1(textToValueFunction != nullptr ? textToValueFunction(text)
                                    : text.getFloatValue());
 }
 
 String ProcessorState::Parameter::getText (float v, int length) const
 {
-    return valueToTextFunction != nullptr ? valueToTextFunction(range.convertFrom0to1(v))
+    return valueToTextFunction != nullptr ? valueToTextFunction(getRange().convertFrom0to1(v))
                : AudioProcessorParameter::getText(v, length);
 }
 
-ProcessorState::Parameter::Parameter (const String& parameterID, const String& paramName, const String& labelText, NormalisableRange<float> r, float defaultVal, std::function<String (float)> valueToText, std::function<float (const String&)> textToValue, bool meta, bool automatable, bool discrete):
+ProcessorState::Parameter::Parameter (ProcessorState& state, int slot, const String& parameterID, const String& paramName, const String& labelText, float defaultVal, std::function<String (float)> valueToText, std::function<float (const String&)> textToValue, bool meta, bool automatable, bool discrete):
     AudioProcessorParameterWithID(parameterID, paramName, labelText),
-    range(r), value(defaultVal),
+    state(state), slot(slot),
     defaultValue(defaultVal), valueToTextFunction(valueToText), textToValueFunction(textToValue),
     isMetaParam(meta),
     isAutomatableParam(automatable),
     isDiscreteParam(discrete)
 {
-    needsUpdate.store(1, std::memory_order_release);
 }
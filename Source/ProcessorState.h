@@ -10,6 +10,12 @@
 
 #pragma once
 #include "JuceHeader.h"
+#include "ProcessorStateParameterBank.h"
+#include "ProcessorStateSmoother.h"
+#include "ProcessorStateEventQueue.h"
+#include "ProcessorStateChunk.h"
+#include "ProcessorStatePayload.h"
+#include "ProcessorStateMorph.h"
 
 /**
 * Manages access to audio processor configuration information including
@@ -20,16 +26,21 @@
 */
 class ProcessorState
     :
-    public Timer
+    private AsyncUpdater,
+    private Timer
 {
 public:
-    explicit ProcessorState (AudioProcessor& processor) : processor(processor) { startTimerHz(10); }
+    explicit ProcessorState (AudioProcessor& processor) : processor(processor) {}
+    ~ProcessorState ();
 
-    void notifyChangedData () const { processor.updateHostDisplay(); }
+    void notifyChangedData ();
 
     class Parameter;
     class SliderAttachment;
     class Data;
+    class Batch;
+    struct ParameterDescriptor;
+    template <typename Layout> class ParameterSet;
 
     /** Creates and returns a new parameter object for controlling a parameter
     with the given ID.
@@ -87,20 +98,200 @@ public:
     /**
     * Returns a ProcessorState::Parameter by its ID string.
     *
-    * @note All functions that use the parameterID do a relatively slow hunt
-    * for the parameter using string comparison.  So it's best to run them once
-    * and then save the returned pointer, rather than calling them all the time
-    * in your processBlock or something.
+    * @note Lookups go through a hash index built as the parameters are
+    * created, so they don't allocate and don't depend on the number of
+    * parameters.  It's still a hash and a string compare though, so save the
+    * returned pointer rather than calling this all the time in your
+    * processBlock.
     */
     Parameter* getParameter (StringRef parameterID) const noexcept;
 
+    /**
+    * Returns the hash used to index parameter and data IDs.  This is a 32-bit
+    * FNV-1a hash of the UTF-8 bytes of the ID.
+    */
+    static uint32 hashID (StringRef id) noexcept;
+
+    /** Compile-time version of hashID(), used by ParameterDescriptor. */
+    static constexpr uint32 hashID (const char* id, uint32 hash = 2166136261u) noexcept
+    {
+        return *id == 0 ? hash : hashID (id + 1, (hash ^ uint8(*id)) * 16777619u);
+    }
+
+    /** Returns the parameter at a position in the order they were created. */
+    Parameter* getParameter (int index) const noexcept { return parameters[index]; }
+
+    int getNumParameters () const noexcept { return parameters.size(); }
+
     /** Returns a pointer to a floating point representation of a particular
       * parameter which a realtime process can read to find out its current value.
       */
-    float* getRawParameterValue (StringRef parameterID) const noexcept;
+    std::atomic<float>* getRawParameterValue (StringRef parameterID) const noexcept;
+
+    /**
+    * Copies the current value of every parameter into a contiguous,
+    * cache-line aligned array and returns it.  The array is indexed in the
+    * order the parameters were created, which is also the order of a
+    * ParameterSet layout.
+    *
+    * Call this once at the top of processBlock and read plain floats from the
+    * array for the rest of the block.  The array stays valid until the next
+    * call.
+    *
+    * THREADING SPEC: Audio thread only.  Doesn't allocate or lock.
+    */
+    const float* snapshot () noexcept;
+
+    /**
+    * Starts a set of parameter changes that are applied together when the
+    * Batch is committed (or destroyed).  Use it for preset loads,
+    * randomisation and morphing: the values go straight into the state and
+    * the host gets one updateHostDisplay() call for the lot, rather than a
+    * setValueNotifyingHost() round trip per parameter.
+    *
+    * @code
+    * auto batch = state.beginBatch();
+    * for (int i = 0; i < state.getNumParameters(); ++i)
+    *     batch.set (i, randomValueFor (i));
+    * batch.commit();
+    * @endcode
+    *
+    * THREADING SPEC: Can be called from any thread.
+    */
+    Batch beginBatch ();
+
+    /**
+    * Sets numValues parameters, starting at firstParameterIndex, to the
+    * unnormalised values given, with a single host notification.  The same as
+    * a Batch with those values in it.
+    *
+    * THREADING SPEC: Can be called from any thread.
+    */
+    void setMany (int firstParameterIndex, const float* unnormalisedValues, int numValues);
+
+    /**
+    * Opts a parameter into per-sample smoothing.  Use updateSmoothing() and
+    * getSmoothedValues() in processBlock to read the ramps.
+    *
+    * THREADING SPEC: Call during the constructor of the PluginProcessor.
+    */
+    void setSmoothing (int parameterIndex, ProcessorStateSmoother::Type type, double timeSeconds);
+
+    /**
+    * Call from your AudioProcessor::prepareToPlay.  Allocates the smoothing
+    * buffers, and starts the timer that passes on parameter changes made on
+    * the audio thread.
+    */
+    void prepareToPlay (double sampleRate, int maximumBlockSize);
+
+    /**
+    * Fills the smoothing ramps for the next numSamples samples.  Call once per
+    * block (or sub-block) before getSmoothedValues().  numSamples must not be
+    * more than the maximumBlockSize passed to prepareToPlay(), so split larger
+    * blocks.
+    *
+    * Only parameters whose value is moving have a ramp generated.
+    *
+    * THREADING SPEC: Audio thread only.  Doesn't allocate or lock.
+    */
+    void updateSmoothing (int numSamples) noexcept;
+
+    /**
+    * Returns the values of a parameter for the samples of the block last passed
+    * to updateSmoothing().  Parameters that aren't smoothed, or aren't moving,
+    * come back as a single value.
+    */
+    ProcessorStateSmoother::Ramp getSmoothedValues (int parameterIndex) const noexcept
+    {
+        return smoother.getRamp(bank, parameterIndex);
+    }
+
+    /**
+    * Drains the parameter changes that arrived since the last block and splits
+    * this block at the points where they happen, for sample-accurate
+    * automation.  Each segment's values array is indexed like snapshot() and
+    * holds the values in force for that segment.
+    *
+    * @code
+    * for (auto segment : state.splitBlock (buffer.getNumSamples()))
+    *     render (buffer, segment.start, segment.length, segment.values[gainIndex]);
+    * @endcode
+    *
+    * The values array is shared with snapshot(), so use one or the other in a
+    * given processBlock.
+    *
+    * THREADING SPEC: Audio thread only.  Doesn't allocate or lock.
+    */
+    ProcessorStateEventQueue::Segments splitBlock (int numSamples) noexcept
+    {
+        noteAudioThread();
+        return events.splitBlock(numSamples, snapshotValues, bank);
+    }
+
+    /**
+    * Sets a parameter from the audio thread at a given sample of the block
+    * about to be processed, for sources that know where a change happens,
+    * such as MIDI controllers or a host's sample-accurate parameter queue.
+    * Call it before splitBlock().  Without splitBlock() the change simply
+    * takes effect for the whole block.
+    *
+    * THREADING SPEC: Audio thread only.  Doesn't allocate or lock.
+    */
+    void setParameterAtSample (int parameterIndex, float newUnnormalisedValue, int sampleOffset) noexcept;
+
+    /** Returns the number of parameter changes splitBlock() lost because its
+     * queue was full.  Those blocks take the latest values without timing. */
+    int getNumDroppedEvents () const noexcept { return events.getNumDropped(); }
+
+    /**
+    * Sets the fastest rate at which Parameter::Listeners are called.  A
+    * change made off the audio thread is dispatched straight away; changes
+    * that arrive sooner than this after a dispatch are held back and
+    * delivered together.
+    *
+    * The audio thread can't post a message, so the changes it makes are
+    * collected by a timer that runs while blocks are being processed: at
+    * this rate while things are changing, backing off to twice a second
+    * while they aren't, and stopping a second after processing stops.
+    * prepareToPlay() starts it.  If the host resumes processing without
+    * calling prepareToPlay(), audio thread changes wait for the next change
+    * from another thread.  When nothing changes and nothing is being
+    * processed the message thread isn't woken at all.  The default is 50Hz.
+    */
+    void setMaximumRefreshRate (int hz);
+
+    /**
+    * Frees the objects replaced in every ProcessorStatePayload belonging to
+    * this state's Data items, off the audio thread.  Use it to set the
+    * memory limit or read the counters.
+    */
+    ProcessorStateReclaimer& getReclaimer () noexcept { return reclaimer; }
+
+    /** Counters for the listener notifications, in case you want to measure them. */
+    struct NotificationStatistics
+    {
+        /** Message thread wake-ups that called at least one listener. */
+        int64 numDispatches;
+
+        /** Message thread wake-ups that found nothing to do, including the
+         * timer's checks for changes made on the audio thread. */
+        int64 numEmptyDispatches;
+
+        /** Time from the first change after an idle period to its listeners being called. */
+        double lastLatencyMs, meanLatencyMs, maxLatencyMs;
+    };
+
+    /** THREADING SPEC: Message thread only. */
+    NotificationStatistics getNotificationStatistics () const noexcept;
+
+    /** THREADING SPEC: Message thread only. */
+    void resetNotificationStatistics () noexcept;
 
     /**
     * Thread-safe, return the current state of the processor configuration.
+    *
+    * The parameters and Data items are captured as they were at one moment,
+    * without blocking the audio thread.
     */
     ValueTree toValueTree () const;
 
@@ -111,8 +302,12 @@ public:
     * THREADING SPEC: It must allow data to be loaded from any thread and,
     * without the use of the message thread (which may be locked by the host),
     * provide all necessary information to the audio processor.
+    *
+    * Each Data item is loaded with Data::prepareToLoad() and then
+    * Data::commitLoad().  Items that already hold their part of the preset
+    * are skipped.  @see loadAsync, getLoadStatistics
     */
-    void load(ValueTree) const;
+    void load(ValueTree);
 
     /** 
      * Save the ProcessorState to the memory block.
@@ -120,6 +315,15 @@ public:
      * Call from your AudioProcessor::getStateInformation call. Use instead of 
      * ProcessorState::toValueTree()
      *
+     * Writes the binary format described in ProcessorStateChunk.  The chunk
+     * is cached: a background thread re-encodes it a short while after the
+     * parameters or Data change, so this is usually just a copy.  If the cache
+     * is out of date it's rebuilt here.  Nothing is re-encoded while the state
+     * isn't changing.
+     *
+     * Like toValueTree(), the chunk holds one coherent point in time even if
+     * the host or UI are changing parameters while it's written.
+     *
      * THREADING SPEC: supports being called from any thread.
      */
     void getStateInformation (MemoryBlock& destData) const;
@@ -129,15 +333,414 @@ public:
      * 
      * Call from your AudioProcessor::setStateInformation call.  Use instead of 
      * ProcessorState::load()
+     *
+     * Reads the binary format, or the XML format older versions saved.
      */
     void setStateInformation (const void* data, int sizeInBytes);
 
+    /** Called as each Data item finishes loading in loadAsync(). */
+    typedef std::function<void (int numItemsDone, int numItems)> LoadProgressCallback;
+
+    /** Called when a loadAsync() finishes.  committed is false if a newer
+     * load replaced it before it could be applied. */
+    typedef std::function<void (bool committed)> LoadCompletionCallback;
+
+    /**
+    * Like load(), but the Data items are loaded in parallel on a pool of
+    * worker threads and this returns straight away.  Use it when the Data
+    * items decode files, so a preset with several samples takes as long as
+    * the slowest decode rather than all of them added up.
+    *
+    * Each item's Data::prepareToLoad() runs on a worker.  When the last one
+    * has finished, the parameters are set and every item's
+    * Data::commitLoad() is called, back to back, so the audio thread carries
+    * on with the old state until the new one is ready and then switches to
+    * it as a whole.
+    *
+    * A load or loadAsync() started before this one finishes supersedes it:
+    * items it hasn't prepared yet are skipped and nothing is committed.
+    *
+    * THREADING SPEC: Can be called from any thread.  The callbacks are
+    * called on a worker thread, or on this thread if there are no Data
+    * items.
+    */
+    void loadAsync (ValueTree root, LoadCompletionCallback onComplete = nullptr, LoadProgressCallback onProgress = nullptr);
+
+    /** setStateInformation() using loadAsync().  @see loadAsync */
+    void setStateInformationAsync (const void* data, int sizeInBytes,
+        LoadCompletionCallback onComplete = nullptr, LoadProgressCallback onProgress = nullptr);
+
+    /**
+    * Opts into lazy loading, for hosts that call setStateInformation()
+    * several times while they open a project.
+    *
+    * load() and setStateInformation() then set the parameters straight away
+    * but only keep each Data item's part of the preset.  The item is
+    * deserialised when Data::ensureLoaded() is called, when the audio thread
+    * asks for it with Data::requestLoad(), or once no load has arrived for
+    * settleTimeMs, whichever comes first.  A load that arrives before then
+    * replaces the one waiting, which is thrown away without being decoded.
+    * Until then the item carries on with its old data, but saving the state
+    * saves the preset that's waiting.
+    *
+    * loadAsync() isn't deferred, and discards any loads that are waiting.
+    *
+    * THREADING SPEC: Call during the constructor of the PluginProcessor.
+    */
+    void setLazyLoading (bool shouldDefer, int settleTimeMs = 500);
+
+    /** Deserialises every Data item that has a load waiting.  @see setLazyLoading */
+    void flushDeferredLoads ();
+
+    /**
+    * Counters for the loads that were skipped because the state was already
+    * what the host handed us, as happens after a save, on transport resets
+    * and during A/B comparisons.
+    *
+    * A Data item is skipped when a content hash of its part of the preset
+    * matches the hash of what the item would save now.  The parameters are
+    * skipped when every value already matches.
+    */
+    struct LoadStatistics
+    {
+        int64 numDataLoaded, numDataSkipped;
+        int64 numParameterBlocksLoaded, numParameterBlocksSkipped;
+    };
+
+    /** THREADING SPEC: Can be called from any thread. */
+    LoadStatistics getLoadStatistics () const noexcept;
+
+    class UndoHistory;
+
+    /**
+    * Turns on the undo history.  Steps are recorded when the last parameter
+    * gesture ends and when UndoHistory::checkpoint() is called, and are
+    * forgotten when the oldest of them no longer fit in maximumSteps or
+    * maximumBytes.
+    *
+    * THREADING SPEC: Call during the constructor of the PluginProcessor,
+    * after the parameters and Data items have been added.
+    */
+    void enableUndo (int maximumSteps = 100, size_t maximumBytes = 8 * 1024 * 1024);
+
+    /** Returns the undo history, or nullptr if enableUndo() wasn't called. */
+    UndoHistory* getUndoHistory () const noexcept { return undoHistory; }
+
+    /**
+    * Sets up morphing between numSnapshots stored states, for example four
+    * for an XY pad.  Store the states with setMorphSnapshot(), move between
+    * them with setMorphWeights(), and call processMorph() in processBlock.
+    *
+    * Continuous parameters are blended.  Discrete parameters and Data items
+    * take the state of whichever snapshot has the most weight, so with two
+    * snapshots they switch halfway across.  The host and the Parameter
+    * listeners hear about the blended values at the rate set by
+    * setMaximumRefreshRate(), not every block.  The Data items are prepared
+    * on the load pool and switched once they're ready, or deferred if
+    * setLazyLoading() is on.
+    *
+    * THREADING SPEC: Call during the constructor of the PluginProcessor,
+    * after the parameters and Data items have been added.
+    */
+    void enableMorph (int numSnapshots);
+
+    /**
+    * Stores the current state as a morph snapshot.
+    *
+    * THREADING SPEC: Any thread except the audio thread.
+    */
+    void setMorphSnapshot (int index);
+
+    /**
+    * Stores a preset, of the kind load() takes, as a morph snapshot.
+    *
+    * THREADING SPEC: Any thread except the audio thread.
+    */
+    void setMorphSnapshot (int index, const ValueTree& preset);
+
+    /**
+    * Sets how much of each snapshot to use.  The weights are scaled to add up
+    * to 1, and the blend glides to them over the glide time.  Until this is
+    * first called the morph leaves the parameters alone, and it stops
+    * changing them once it has arrived.  A parameter the user is dragging is
+    * never changed by it.
+    *
+    * THREADING SPEC: Can be called from any thread.  Doesn't allocate or lock.
+    */
+    void setMorphWeights (const float* weights, int numWeights) noexcept;
+
+    /** Sets how long a change of weights takes.  The default is 20ms. */
+    void setMorphGlideTime (double seconds) noexcept;
+
+    /**
+    * Applies the morph for the next numSamples samples.  Call at the top of
+    * processBlock, before updateSmoothing() or snapshot().
+    *
+    * THREADING SPEC: Audio thread only.  Doesn't allocate or lock.
+    */
+    void processMorph (int numSamples) noexcept;
+
 
 private:
+    /**
+     * Open-addressed table mapping precomputed ID hashes to positions in the
+     * parameters or dataItems arrays.  Entries are only added while the
+     * processor is being constructed, so lookups never allocate or lock.
+     */
+    class IdIndex
+    {
+    public:
+        void add (uint32 hash, int position);
+
+        /** Returns the position of the first entry with this hash for which
+         * matches(position) is true, or -1. */
+        template <typename Predicate>
+        int find (uint32 hash, Predicate matches) const noexcept
+        {
+            if (slots.size() == 0)
+                return -1;
+
+            const int mask = slots.size() - 1;
+
+            for (int i = int(hash) & mask;; i = (i + 1) & mask)
+            {
+                const Slot & slot = slots.getReference(i);
+
+                if (slot.position < 0)
+                    return -1;
+
+                if (slot.hash == hash && matches(slot.position))
+                    return slot.position;
+            }
+        }
+
+    private:
+        struct Slot
+        {
+            uint32 hash;
+            int position;
+        };
+
+        void insert (Slot slot) noexcept;
+
+        Array<Slot> slots;
+        int numUsed{ 0 };
+    };
+
+    ProcessorStateEpochs epochs;    // before dataItems, which use these
+    ProcessorStateReclaimer reclaimer{ epochs };
     OwnedArray<Data> dataItems;
+    Array<Parameter*> parameters;
+    Array<uint32> parameterHashes;
+    IdIndex parameterIndex;
+    IdIndex dataIndex;
+
+    ProcessorStateParameterBank bank;
+    ProcessorStateSmoother smoother;
+    ProcessorStateEventQueue events;
+    HeapBlock<char> snapshotStorage;
+    float* snapshotValues{ nullptr };
+
+    int findParameterPosition (StringRef parameterID) const noexcept;
+    int findDataPosition (StringRef dataID) const noexcept;
+
+    /* Compile-time check used by ParameterSet.  UniqueIdCheck derives from
+     * one ParameterIdHash per descriptor, so two descriptors with the same ID
+     * (or ID hash) make it inherit the same base twice, which won't compile. */
+    template <int...> struct IndexList {};
+    template <typename A, typename B> struct JoinIndexLists;
+    template <int N> struct MakeIndexList;
+    template <uint32 idHash> struct ParameterIdHash {};
+    template <typename Layout, typename Indices> struct UniqueIdCheck;
+
     void forEachParameter (std::function<void(int, Parameter*)> func) const;
+    void loadChunk (const ProcessorStateChunk::Reader& chunk);
+
+    /* Loading, shared by the synchronous and asynchronous paths.  The
+     * collect functions fill an array of unnormalised values (one per
+     * parameter) or trees (one per Data item, invalid if the item is
+     * missing). */
+    void collectParameterValues (const ValueTree& root, float* values) const;
+    void collectParameterValues (const ProcessorStateChunk::Reader& chunk, float* values) const;
+    void collectDataTrees (const ValueTree& root, Array<ValueTree>& trees) const;
+    static ValueTree readDataBlob (const void* blob, size_t size, size_t uncompressedSize);
+    static void loadDataItem (Data& d, const ValueTree& tree);
+
+    /* Redundant load detection.  A Data item is unchanged if the hash of the
+     * incoming blob matches the hash of its current encoding (compressed or
+     * not, to match the blob).  applyParameterValues() only calls setMany()
+     * if a value differs, and returns true if it did.  Both update the LoadStatistics counters. */
+    bool isUnchanged (Data& d, const void* blob, size_t size, bool isCompressed);
+    bool isUnchanged (Data& d, const ValueTree& tree);
+    bool applyParameterValues (const float* values);
+
+    std::atomic<int64> numDataLoaded{ 0 }, numDataSkipped{ 0 };
+    std::atomic<int64> numParameterBlocksLoaded{ 0 }, numParameterBlocksSkipped{ 0 };
+
+    /* Asynchronous loading.  Every load takes the next loadSequence.  A
+     * preset load is recorded in presetSequence and a morph switch in
+     * morphSequence, and a loadAsync() only commits if it's still the
+     * latest (see isCurrent()).  loadLock is held while a load is applied,
+     * so commits and synchronous loads don't interleave. */
+    class AsyncLoad;
+    class LoadJob;
+
+    void startAsyncLoad (std::shared_ptr<AsyncLoad> load);
+    void commitAsyncLoad (AsyncLoad& load);
+    bool isCurrent (const AsyncLoad& load) const noexcept;
+
+    std::atomic<uint32> loadSequence{ 0 };
+    std::atomic<uint32> presetSequence{ 0 };
+    std::atomic<uint32> morphSequence{ 0 };
+    CriticalSection loadLock;
+
+    /* One pool for the whole process, so several plugin instances loading
+     * at once don't each start a thread per core. */
+    struct LoadPool
+    {
+        LoadPool () : pool(jmax(1, SystemStats::getNumCpus() - 1)) {}
+        ThreadPool pool;
+    };
+
+    SharedResourcePointer<LoadPool> loadPool;
+
+    /* Lazy loading.  A deferred load stores a DeferredData in each item;
+     * blobs from a chunk are copied and only parsed when they're needed.
+     * The deferred loader thread sleeps until something is deferred, then
+     * polls for requestLoad() calls until the loads have settled and been
+     * applied. */
+    struct DeferredData
+    {
+        ValueTree tree;
+        MemoryBlock blob;
+        size_t uncompressedSize;
+        bool isBlob;
+
+        ValueTree getTree () const { return isBlob ? readDataBlob(blob.getData(), blob.getSize(), uncompressedSize) : tree; }
+    };
+
+    class DeferredLoaderThread;
+
+    void deferDataItem (Data& d, std::shared_ptr<const DeferredData> deferred);
+    bool applyDeferredLoads (bool settled);
+
+    bool lazyLoading{ false };
+    int loadSettleTimeMs{ 500 };
+    std::atomic<int64> lastDeferTicks{ 0 };
+    ScopedPointer<DeferredLoaderThread> deferredLoader;
+
+    /* The last output of a Data item's serialize(), as a tree and encoded
+     * with ValueTree::writeToStream(), along with the Data generation it was
+     * made at.  Treat the tree as read-only. */
+    struct EncodedData
+    {
+        uint32 generation;
+        ValueTree tree;
+        MemoryBlock data;
+        MemoryBlock compressed;    // empty unless the item asked for compression and it helped
+        uint64 hash;               // ProcessorStateChunk::hashContent() of data
+        uint64 compressedHash;     // and of compressed, if it isn't empty
+    };
+
+    /* Saving captures the parameters and Data items as they were at one
+     * moment.  The parameter values come from the bank's seqlock read.  The
+     * Data encodings are taken first, and the whole capture is repeated if
+     * any Data::notifyChanged() call (counted by dataGeneration) happened
+     * before the parameters were read.  Only changed items are re-serialised
+     * on a retry, and after maxSnapshotAttempts the last capture is used. */
+    struct Snapshot
+    {
+        HeapBlock<float> values;
+        Array<std::shared_ptr<const EncodedData>> data;
+    };
+
+    void captureSnapshot (Snapshot& snapshot) const;
+
+    /* Morphing.  processMorph() writes the blend into the bank and marks the
+     * slots it changed in morphDirty and the snapshot Data items should
+     * follow in morphDataTarget; dispatchParameterChanges() passes both on,
+     * switching the Data items with a loadAsync() that only covers them.
+     * morphData holds each snapshot's Data trees, one per item. */
+    void dispatchMorphChanges ();
+
+    ScopedPointer<ProcessorStateMorph> morph;
+    HeapBlock<float> morphValues;
+    ProcessorStateDirtyBits morphDirty;
+    Array<Array<ValueTree>> morphData;
+    CriticalSection morphLock;
+    std::atomic<int> morphDataTarget{ -1 };
+    int morphDataApplied{ -1 };
+
+    /* Undo.  numGestures counts the parameters in a gesture; the history
+     * records a step when it drops to zero. */
+    ScopedPointer<UndoHistory> undoHistory;
+    std::atomic<int> numGestures{ 0 };
+
+    static constexpr int maxSnapshotAttempts = 4;
+    std::atomic<uint32> dataGeneration{ 0 };
+
+    /* Batch support.  applyWithoutNotifyingHost() returns true if the value
+     * changed; finishBatch() then sends the one notification for the lot. */
+    bool applyWithoutNotifyingHost (int parameterIndex, float newUnnormalisedValue);
+    void finishBatch (bool anyChanged);
+
+    /* The cached state chunk.  stateGeneration goes up whenever something
+     * getStateInformation() writes changes.  getCurrentBlob() returns the
+     * cached blob if it was written at the current generation and otherwise
+     * encodes a new one.  The blob writer thread sleeps on blobChanged,
+     * which notifyChangedData() and dispatchParameterChanges() signal, and
+     * does that encoding in the background once the changes have settled. */
+    struct StateBlob
+    {
+        uint32 generation;
+        MemoryBlock data;
+    };
+
+    class BlobWriterThread;
+
+    std::shared_ptr<const StateBlob> getCurrentBlob () const;
+    bool isBlobStale () const;
+    void writeChunk (MemoryBlock& destData) const;
+
+    std::atomic<uint32> stateGeneration{ 1 };
+    mutable std::shared_ptr<const StateBlob> cachedBlob;    // only use with std::atomic_load/store
+    CriticalSection blobLock;
+    WaitableEvent blobChanged;
+    mutable ScopedPointer<BlobWriterThread> blobWriter;
+
+    /* Listener notification.  markParameterChanged() is called on any thread
+     * after a bank slot has been marked dirty.  It bumps stateGeneration and
+     * sets dispatchPending, and off the audio thread the first mark after a
+     * dispatch also triggers an async update.  The audio thread is whichever
+     * thread last called one of the per-block functions, which call
+     * noteAudioThread(); its marks are left for the timer.
+     * dispatchParameterChanges() calls the listeners for every dirty slot.
+     *
+     * The timer holds back dispatches that would come sooner than
+     * minimumDispatchIntervalMs after the last one, and while numAudioCalls
+     * keeps moving it looks for audio thread marks, backing off to
+     * maximumPollIntervalMs.  It stops after audioQuietMs without any. */
+    void markParameterChanged () noexcept;
+    void noteAudioThread () noexcept;
+    void dispatchParameterChanges ();
+    void handleAsyncUpdate () override;
     void timerCallback () override;
 
+    static constexpr int maximumPollIntervalMs = 500;
+    static constexpr int audioQuietMs = 1000;
+
+    std::atomic<bool> dispatchPending{ false };
+    std::atomic<bool> dispatchScheduled{ false };
+    std::atomic<int64> firstChangeTicks{ 0 };
+    std::atomic<Thread::ThreadID> audioThread{ nullptr };
+    std::atomic<uint32> numAudioCalls{ 0 };
+    std::atomic<int64> watchStartTicks{ 0 };
+    uint32 lastNumAudioCalls{ 0 };
+    int64 lastAudioTicks{ 0 };
+    int64 lastDispatchTicks{ 0 };
+    int minimumDispatchIntervalMs{ 1000 / 50 };
+    NotificationStatistics statistics{ 0, 0, 0.0, 0.0, 0.0 };
+
     AudioProcessor & processor;
 };
 
@@ -157,7 +760,7 @@ public:
     /** Returns the normalised value */
     float getValue () const override;
 
-    /** Returns the _unnormalised_ default value */
+    /** Returns the normalised default value, as the host expects */
     float getDefaultValue () const override;
 
     float getValueForText (const String& text) const override;
@@ -180,7 +783,24 @@ public:
      */
     void setUnnormalisedValue (float newUnnormalisedValue);
 
-    NormalisableRange<float> getRange() const { return range; }
+    NormalisableRange<float> getRange() const { return state.bank.getRange(slot); }
+
+    /** Returns the unnormalised value. */
+    float getUnnormalisedValue () const noexcept { return state.bank.getValue(slot); }
+
+    /** Returns the unnormalised value for a realtime process to read. */
+    std::atomic<float>* getRawValue () const noexcept { return state.bank.getRawValue(slot); }
+
+    /**
+    * Wraps beginChangeGesture() and endChangeGesture() and keeps count of
+    * them, so the state knows the user is part way through editing this
+    * parameter.  Attachments should use these.  A Batch won't bypass the host
+    * for a parameter in a gesture; its change goes through
+    * setValueNotifyingHost() so the host still sees one unbroken gesture.
+    */
+    void beginGesture ();
+    void endGesture ();
+    bool isInGesture () const noexcept { return gestureDepth.load() > 0; }
 
     bool isMetaParameter () const override;
     bool isAutomatable () const override;
@@ -203,27 +823,186 @@ public:
     void addListener (Listener* l);
     void removeListener (Listener* l);
 
-    float value; /**< should this be a std::atomic<float> really? */
-
 private:
     friend class ProcessorState;
 
-    Parameter (const String& parameterID, const String& paramName, const String& labelText,
-        NormalisableRange<float> r, float defaultVal, std::function<String (float)> valueToText,
+    Parameter (ProcessorState& state, int slot,
+        const String& parameterID, const String& paramName, const String& labelText,
+        float defaultVal, std::function<String (float)> valueToText,
         std::function<float (const String&)> textToValue, bool meta, bool automatable, bool discrete);
 
     void callMessageThreadListeners ();
 
-    NormalisableRange<float> range;
+    /* The value, range and dirty flag live in the state's bank; everything
+     * here is only needed off the audio thread. */
+    ProcessorState& state;
+    const int slot;
     float defaultValue;
     ListenerList<Listener> listeners;
     std::function<String (float)> valueToTextFunction;
     std::function<float (const String&)> textToValueFunction;
-    std::atomic<int> needsUpdate;
     const bool isMetaParam, isAutomatableParam, isDiscreteParam;
+    std::atomic<int> gestureDepth{ 0 };
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Parameter)
 };
 
+/**
+ * A set of parameter changes applied together.  Get one from
+ * ProcessorState::beginBatch().
+ *
+ * commit() writes every value into the state in one pass, wakes the
+ * Parameter::Listeners once and calls AudioProcessor::updateHostDisplay()
+ * once, after which the host re-reads the parameter values.  Changes to a
+ * parameter the user is dragging are the exception: they are sent with
+ * setValueNotifyingHost() so the host's gesture isn't broken.
+ *
+ * Anything not committed is committed when the Batch is destroyed.
+ */
+class ProcessorState::Batch
+{
+public:
+    Batch (Batch&& other) noexcept;
+    ~Batch ();
+
+    /** Queues a new unnormalised value for the parameter at this index. */
+    void set (int parameterIndex, float newUnnormalisedValue);
+
+    /** Queues a new unnormalised value for this parameter. */
+    void set (Parameter& parameter, float newUnnormalisedValue);
+
+    /** Applies the queued changes and sends the notifications.  The Batch can be reused afterwards. */
+    void commit ();
+
+private:
+    friend class ProcessorState;
+
+    explicit Batch (ProcessorState& state) : state(&state) {}
+
+    struct Change
+    {
+        int parameterIndex;
+        float value;
+    };
+
+    ProcessorState* state;
+    Array<Change> changes;
+
+    JUCE_DECLARE_NON_COPYABLE (Batch)
+};
+
+/**
+ * Undo and redo for a ProcessorState.  Get it from
+ * ProcessorState::getUndoHistory() after calling enableUndo().
+ *
+ * Each step holds only what changed: the parameters that moved, with their
+ * old and new values, and for each Data item that changed the bytes of its
+ * serialised form that differ, with the common start and end trimmed off.
+ * Editing one zone of a large zone map costs the bytes around that zone,
+ * not two copies of the map.
+ *
+ * A step is the difference between two checkpoints.  The end of the last
+ * parameter gesture is a checkpoint, so a slider drag is one step however
+ * many values it went through.  Call checkpoint() yourself after other
+ * edits, such as choosing a file.  Anything else that changed in between,
+ * host automation included, becomes part of the next step.
+ *
+ * Undo and redo go through the same paths as ProcessorState::load(): the
+ * parameters are set as a Batch and the Data items are loaded with
+ * prepareToLoad() and commitLoad(), so the audio thread is never blocked.
+ * Loading a preset clears the history.
+ *
+ * THREADING SPEC: Any thread except the audio thread.
+ */
+class ProcessorState::UndoHistory
+{
+public:
+    /**
+    * Records the changes since the last checkpoint as a step, and forgets
+    * anything that could have been redone.  Returns false if nothing has
+    * changed, or if a parameter is in a gesture (the end of the gesture
+    * records it).
+    */
+    bool checkpoint ();
+
+    /** Records any changes, then undoes the last step.  Returns false if
+     * there's nothing to undo. */
+    bool undo ();
+
+    /** Redoes the last step undone.  Returns false if there's nothing to redo. */
+    bool redo ();
+
+    bool canUndo () const;
+    bool canRedo () const;
+
+    /** Forgets every step and takes the current state as the starting point. */
+    void clear ();
+
+    /** Sets how many steps are kept, and the memory they may use. */
+    void setLimits (int maximumSteps, size_t maximumBytes);
+
+    struct Statistics
+    {
+        int numUndoSteps, numRedoSteps;
+
+        /** Memory held by the steps. */
+        size_t bytes;
+
+        /** Steps forgotten because they didn't fit the limits. */
+        int64 numDiscarded;
+    };
+
+    Statistics getStatistics () const;
+
+private:
+    friend class ProcessorState;
+
+    UndoHistory (ProcessorState& state, int maximumSteps, size_t maximumBytes);
+
+    struct ParameterChange
+    {
+        int index;
+        float before, after;
+    };
+
+    /* The serialised item was prefix + before + suffix bytes and became
+     * prefix + after + suffix. */
+    struct DataChange
+    {
+        int index;
+        size_t prefix, suffix;
+        MemoryBlock before, after;
+    };
+
+    struct Step
+    {
+        Array<ParameterChange> parameters;
+        Array<DataChange> data;
+        size_t bytes;
+    };
+
+    bool recordStep ();
+    void apply (const Step& step, bool backwards);
+    void trimToLimits ();
+
+    static DataChange diff (int index, const MemoryBlock& before, const MemoryBlock& after);
+
+    ProcessorState& state;
+    CriticalSection lock;
+
+    /* Steps before position can be undone; from position on they can be
+     * redone.  baseline is the state at the last checkpoint. */
+    OwnedArray<Step> steps;
+    int position{ 0 };
+    Snapshot baseline;
+
+    int maximumSteps;
+    size_t maximumBytes;
+    size_t totalBytes{ 0 };
+    int64 numDiscarded{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE (UndoHistory)
+};
+
 /**
  * Base class for classes containing data saved with the preset but not exposed
  * as a parameter.
@@ -257,6 +1036,54 @@ public:
     void addListener(Listener * l) { listeners.add(l); }
     void removeListener(Listener * l) { listeners.remove(l); }
 
+    /**
+     * Returns a number that goes up every time notifyChanged() is called.
+     * It's also saved with the item in the state chunk, so two chunks saved
+     * by the same instance can be compared to see which items changed.
+     *
+     * THREADING SPEC: may be called from any thread.
+     */
+    uint32 getGeneration () const noexcept { return generation.load(); }
+
+    /**
+     * Asks for this item to be zlib-compressed in the state chunk, if its
+     * serialised form is at least minimumSize bytes.  Worth it for zone maps
+     * and envelopes that make host project files large; not worth it for a
+     * file name.  The compression is done once per change, not on every
+     * save.
+     *
+     * THREADING SPEC: Call before the state is first saved, e.g. in your
+     * constructor.
+     */
+    void setCompression (bool shouldCompress, size_t minimumSize = 1024)
+    {
+        compress = shouldCompress;
+        compressionThreshold = minimumSize;
+    }
+
+    /**
+     * Deserialises this item now if a lazy load has left it waiting.  Call it
+     * before reading the item from the UI.  @see ProcessorState::setLazyLoading
+     *
+     * THREADING SPEC: Any thread except the audio thread.
+     */
+    void ensureLoaded ();
+
+    /** Returns true while a lazy load is waiting for this item.
+     *
+     * THREADING SPEC: may be called from any thread.  Doesn't lock. */
+    bool hasPendingLoad () const noexcept { return std::atomic_load(&deferredLoad) != nullptr; }
+
+    /**
+     * Asks for a waiting load to be applied now rather than after the settle
+     * time.  It's applied on the state's loader thread, so the audio thread
+     * carries on with the old data until then.
+     *
+     * THREADING SPEC: may be called from any thread, including the audio
+     * thread.  Doesn't allocate or lock.
+     */
+    void requestLoad () noexcept { loadRequested = true; }
+
 protected:
     /** Save the contents of your implementation to a ValueTree.
      *
@@ -298,10 +1125,70 @@ protected:
      */
     virtual void setToDefaultState () = 0;
 
+    /**
+     * The first half of a load.  ProcessorState::loadAsync() calls it on a
+     * worker thread, in parallel with the other items; load() calls it on
+     * the loading thread.  An invalid tree means the preset doesn't include
+     * this item.
+     *
+     * Override this and commitLoad() to keep the audio thread on the old data
+     * until the whole preset is ready: do the slow work here (decode the
+     * file, build the zone map) into somewhere the audio thread doesn't
+     * look, then make it live in commitLoad().  The default calls
+     * deserialize(), or setToDefaultState() for an invalid tree, and so
+     * changes the live data straight away.
+     *
+     * THREADING SPEC
+     * - This function may be called on any thread.
+     * - Calls for the same item never overlap.
+     */
+    virtual bool prepareToLoad (ValueTree valuetree)
+    {
+        if (! valuetree.isValid())
+        {
+            setToDefaultState();
+            return true;
+        }
+
+        return deserialize(valuetree);
+    }
+
+    /**
+     * The second half of a load, called after prepareToLoad() succeeded for
+     * this item and every other item in the preset.  Swap in the prepared
+     * data and call notifyChanged().  Keep it quick.  The default does
+     * nothing.
+     *
+     * THREADING SPEC: may be called on any thread.
+     */
+    virtual void commitLoad () {}
+
+    /**
+     * Called instead of commitLoad() when the preset that prepareToLoad() was
+     * preparing is superseded before it's committed.  Free whatever was
+     * prepared.  The default does nothing.
+     *
+     * THREADING SPEC: may be called on any thread.
+     */
+    virtual void cancelLoad () {}
+
+    /**
+     * Throws away a lazy load that's waiting for this item.  Call it when the
+     * user changes the item, so their change isn't overwritten later by the
+     * preset that was waiting.
+     *
+     * THREADING SPEC: may be called from any thread.
+     */
+    void discardPendingLoad () { std::atomic_store(&deferredLoad, std::shared_ptr<const DeferredData>()); }
+
     /** 
      * Call from your implementation when the data has changed (e.g. the user
      * changed the UI and the state may need saving.  
      *
+     * The output of serialize() is cached and only regenerated after this
+     * has been called, so anything that changes what serialize() would return
+     * must call it.
+     *
      * THREADING SPEC: may be called from any thread**.
      * 
      * ** need to check updateHostDisplay
@@ -314,10 +1201,23 @@ private:
     /** @internal - triggers a call to the listeners. */
     void handleAsyncUpdate () override;
 
+    /* Returns the cached output of serialize() if the generation hasn't
+     * moved since it was made, and otherwise calls serialize() again. */
+    std::shared_ptr<const EncodedData> getEncoded ();
+
     ProcessorState & state;
     ListenerList<Listener> listeners;
     String dataID;
     std::atomic<int> needsUpdate;
+    std::atomic<uint32> generation{ 1 };
+    CriticalSection loadLock;
+    uint32 preparedSequence{ 0 };    // the loadAsync() that prepared this item; guarded by loadLock
+    bool compress{ false };
+    size_t compressionThreshold{ 0 };
+    std::shared_ptr<const EncodedData> cachedEncoding;    // only use with std::atomic_load/store
+    CriticalSection encodeLock;
+    std::shared_ptr<const DeferredData> deferredLoad;     // only use with std::atomic_load/store/exchange
+    std::atomic<bool> loadRequested{ false };
 };
 
 
@@ -328,7 +1228,8 @@ private:
  * has finished.
  * 
  * This is an easy example.  A more complex object might include an entire
- * sampler configuration.
+ * sampler configuration.  See ProcessorStateLoadedFile for a version that
+ * hands what it loads to the audio thread without locking.
  */
 class ProcessorStateFile : public ProcessorState::Data
 {
@@ -347,12 +1248,13 @@ public:
     /** Call from the UI when the user selects another file. */
     void setFile(const File & newFile, NotificationType uiNotificationType)
     {
+        discardPendingLoad();
         ScopedLock l(criticalSection);
 
         if (file != newFile)
         {
             file = newFile;
-            actionOnChange(file);
+            applyFile(file);
             notifyChanged(uiNotificationType);
         }
     }
@@ -365,6 +1267,22 @@ public:
     }
 
 protected:
+    /** Called by setFile() to switch to a new file.  The default calls
+     * actionOnChange. */
+    virtual void applyFile (const File & newFile) { actionOnChange(newFile); }
+
+    /** The slow half of switching to a file during a preset load.  Get ready
+     * without changing anything the audio thread reads.  The default calls
+     * actionOnChange, which switches straight away. */
+    virtual void prepareFile (const File & newFile) { actionOnChange(newFile); }
+
+    /** Makes the file from prepareFile() live.  The default does nothing. */
+    virtual void commitFile () {}
+
+    /** Throws away the file from prepareFile() when the load is superseded.
+     * The default does nothing. */
+    virtual void cancelFile () {}
+
     void setToDefaultState () override
     {
         setFile(File(), sendNotification);
@@ -380,6 +1298,48 @@ protected:
         return true;
     }
 
+    bool prepareToLoad (ValueTree valuetree) override
+    {
+        if (valuetree.isValid() && valuetree.getType() != Identifier("ProcessorStateFile"))
+            return false;
+
+        const File newFile = valuetree.isValid() ? File(valuetree["file"].toString()) : File();
+
+        ScopedLock l(criticalSection);
+
+        pendingFile = newFile;
+        hasPendingFile = (newFile != file);
+
+        if (hasPendingFile)
+            prepareFile(newFile);
+
+        return true;
+    }
+
+    void commitLoad () override
+    {
+        ScopedLock l(criticalSection);
+
+        if (! hasPendingFile)
+            return;
+
+        file = pendingFile;
+        hasPendingFile = false;
+        commitFile();
+        notifyChanged(sendNotification);
+    }
+
+    void cancelLoad () override
+    {
+        ScopedLock l(criticalSection);
+
+        if (! hasPendingFile)
+            return;
+
+        hasPendingFile = false;
+        cancelFile();
+    }
+
     ValueTree serialize () override
     {
         ScopedLock l(criticalSection);
@@ -389,10 +1349,189 @@ protected:
     }
 
     File file;
+    File pendingFile;
+    bool hasPendingFile{ false };
     CriticalSection criticalSection;
     std::function<void(const File& action)> actionOnChange;
 };
 
+/**
+ * A ProcessorStateFile that loads the file into an object of type PayloadType
+ * (an AudioBuffer, say) and publishes it through a ProcessorStatePayload.
+ *
+ * The audio thread reads the object with a ProcessorStatePayload::Reader and
+ * always sees a complete old or new one, without locking.  During a preset
+ * load the file is decoded in prepareToLoad() and only published in
+ * commitLoad(), so with ProcessorState::loadAsync() the audio thread keeps
+ * playing the old object until the whole preset is ready.
+ */
+template <typename PayloadType>
+class ProcessorStateLoadedFile : public ProcessorStateFile
+{
+public:
+    /** Loads a file, returning nullptr if it can't.  Might be called on any
+     * thread, but never the audio thread. */
+    typedef std::function<std::unique_ptr<PayloadType> (const File&)> Loader;
+
+    ProcessorStateLoadedFile (ProcessorState & state, const String & dataID, Loader loader)
+    :
+    ProcessorStateFile(state, dataID, nullptr),
+    loader(loader),
+    payload(state.getReclaimer())
+    {}
+
+    const ProcessorStatePayload<PayloadType>& getPayload () const noexcept { return payload; }
+
+protected:
+    void applyFile (const File & newFile) override { payload.publish(loader(newFile)); }
+    void prepareFile (const File & newFile) override { pending = loader(newFile); }
+    void commitFile () override { payload.publish(std::move(pending)); }
+    void cancelFile () override { pending.reset(); }
+
+private:
+    Loader loader;
+    ProcessorStatePayload<PayloadType> payload;
+    std::unique_ptr<PayloadType> pending;
+};
+
+/**
+ * A compile-time description of a parameter, for use in a parameter layout.
+ *
+ * A layout is a struct with an enum called Index that ends in numParameters,
+ * and a table of descriptors in the same order:
+ *
+ * @code
+ * struct MyParameters
+ * {
+ *     enum Index { gain, cutoff, numParameters };
+ *
+ *     static constexpr ProcessorState::ParameterDescriptor descriptors[numParameters]
+ *     {
+ *         { "gain",   "Gain",   "",   1.0f,    0.0f, 2.0f },
+ *         { "cutoff", "Cutoff", "Hz", 1000.0f, 20.0f, 20000.0f, 0.0f, 0.3f }
+ *     };
+ * };
+ * @endcode
+ *
+ * Pass the layout to ProcessorState::ParameterSet to create the parameters.
+ */
+struct ProcessorState::ParameterDescriptor
+{
+    enum Flags
+    {
+        none = 0,
+        meta = 1,
+        notAutomatable = 2,
+        discrete = 4
+    };
+
+    constexpr ParameterDescriptor (const char* parameterID, const char* parameterName, const char* labelText,
+        float defaultValue, float start, float end, float interval = 0.0f, float skew = 1.0f, int flags = none)
+    :
+    id(parameterID), name(parameterName), label(labelText),
+    defaultValue(defaultValue), start(start), end(end), interval(interval), skew(skew),
+    flags(flags), idHash(ProcessorState::hashID(parameterID))
+    {}
+
+    const char* id;
+    const char* name;
+    const char* label;
+    float defaultValue;
+    float start, end, interval, skew;
+    int flags;
+    uint32 idHash;
+};
+
+template <int... A, int... B>
+struct ProcessorState::JoinIndexLists<ProcessorState::IndexList<A...>, ProcessorState::IndexList<B...>>
+{
+    typedef IndexList<A..., int(sizeof...(A)) + B...> Type;
+};
+
+template <int N>
+struct ProcessorState::MakeIndexList
+{
+    typedef typename JoinIndexLists<typename MakeIndexList<N / 2>::Type,
+                                    typename MakeIndexList<N - N / 2>::Type>::Type Type;
+};
+
+template <> struct ProcessorState::MakeIndexList<0> { typedef IndexList<> Type; };
+template <> struct ProcessorState::MakeIndexList<1> { typedef IndexList<0> Type; };
+
+template <typename Layout, int... I>
+struct ProcessorState::UniqueIdCheck<Layout, ProcessorState::IndexList<I...>>
+    : ParameterIdHash<Layout::descriptors[I].idHash>...
+{
+};
+
+/**
+ * Creates the parameters described by a layout (see ParameterDescriptor) and
+ * gives indexed access to them.
+ *
+ * Duplicate IDs in the layout (or two IDs with the same hash) are a compile
+ * error.  Lookups are an array index, so it's fine to use operator[] and
+ * getRawValue() from processBlock.
+ *
+ * THREADING SPEC: Construct during the constructor of the PluginProcessor, as
+ * for createAndAddParameter.
+ */
+template <typename Layout>
+class ProcessorState::ParameterSet
+{
+public:
+    typedef typename Layout::Index Index;
+
+    explicit ParameterSet (ProcessorState& state)
+        : state (state), firstIndex (state.getNumParameters())
+    {
+        /* Errors about a duplicate ParameterIdHash base here mean two
+         * parameters in the layout have the same ID (or the same ID hash). */
+        static_assert (sizeof (UniqueIdCheck<Layout, typename MakeIndexList<Layout::numParameters>::Type>) > 0, "");
+
+        for (int i = 0; i < Layout::numParameters; ++i)
+        {
+            const ParameterDescriptor& d = Layout::descriptors[i];
+
+            parameters[i] = state.createAndAddParameter(d.id, d.name, d.label,
+                { d.start, d.end, d.interval, d.skew }, d.defaultValue, nullptr, nullptr,
+                (d.flags & ParameterDescriptor::meta) != 0,
+                (d.flags & ParameterDescriptor::notAutomatable) == 0,
+                (d.flags & ParameterDescriptor::discrete) != 0);
+        }
+    }
+
+    Parameter& operator[] (Index index) const noexcept { return *parameters[index]; }
+
+    /** Returns the value a realtime process should read for this parameter. */
+    std::atomic<float>* getRawValue (Index index) const noexcept { return parameters[index]->getRawValue(); }
+
+    /** Reads this set's parameter from an array returned by ProcessorState::snapshot(). */
+    float get (const float* snapshot, Index index) const noexcept { return snapshot[firstIndex + index]; }
+
+    /** @see ProcessorState::setSmoothing */
+    void setSmoothing (Index index, ProcessorStateSmoother::Type type, double timeSeconds)
+    {
+        state.setSmoothing(firstIndex + index, type, timeSeconds);
+    }
+
+    /** @see ProcessorState::getSmoothedValues */
+    ProcessorStateSmoother::Ramp getSmoothed (Index index) const noexcept
+    {
+        return state.getSmoothedValues(firstIndex + index);
+    }
+
+    static const ParameterDescriptor& getDescriptor (Index index) noexcept { return Layout::descriptors[index]; }
+
+    static constexpr int size () noexcept { return Layout::numParameters; }
+
+private:
+    ProcessorState& state;
+    const int firstIndex;
+    Parameter* parameters[Layout::numParameters];
+
+    JUCE_DECLARE_NON_COPYABLE (ParameterSet)
+};
+
 /**
 * Connect a slider to a parameter.
 */
@@ -400,23 +1539,40 @@ class ProcessorState::SliderAttachment : Slider::Listener, Parameter::Listener
 {
 public:
     SliderAttachment (ProcessorState& state, const String& paramID, Slider& slider)
-        : slider (slider)
+        : slider (slider), parameter (state.getParameter(paramID))
     {
-        parameter = state.getParameter(paramID);
-
         /**
          * Asserts here? paramID was not valid.  All parameters must be created
          * before building the UI.
          */
         jassert(parameter);
 
-        auto r{ parameter->getRange() };
+        attach();
+    }
+
+    /** Attach to a parameter directly, e.g. one from a ParameterSet. */
+    SliderAttachment (Parameter& parameter, Slider& slider)
+        : slider (slider), parameter (&parameter)
+    {
+        attach();
+    }
+
+    ~SliderAttachment()
+    {
+        parameter->removeListener(this);
+        slider.removeListener (this);
+    }
+
+private:
+    void attach ()
+    {
+        auto r = parameter->getRange();
 
         slider.setRange (r.start, r.end, r.interval);
         slider.setSkewFactor (r.skew, r.symmetricSkew);
 
         slider.setDoubleClickReturnValue (true, r.convertFrom0to1 (parameter->getDefaultValue()));
-        slider.setValue(*state.getRawParameterValue(paramID), dontSendNotification);
+        slider.setValue(parameter->getUnnormalisedValue(), dontSendNotification);
 
         slider.addListener (this);
         parameter->addListener(this);
@@ -424,13 +1580,6 @@ public:
         updateControlValue();
     }
 
-    ~SliderAttachment()
-    {
-        parameter->removeListener(this);
-        slider.removeListener (this);
-    }
-
-private:
     void parameterChanged (const String&, float) override { updateControlValue(); }
 
     void updateControlValue ()
@@ -438,7 +1587,7 @@ private:
         ScopedValueSetter<bool> svs (ignoreCallbacks, true);
         jassert(MessageManager::getInstance()->isThisTheMessageThread());
 
-        slider.setValue (parameter->value, sendNotificationSync);
+        slider.setValue (parameter->getUnnormalisedValue(), sendNotificationSync);
     }
 
     void sliderValueChanged (Slider* s) override
@@ -447,8 +1596,8 @@ private:
             parameter->setUnnormalisedValue(float(s->getValue()));
     }
 
-    void sliderDragStarted (Slider*) override { parameter->beginChangeGesture(); }
-    void sliderDragEnded   (Slider*) override { parameter->endChangeGesture(); }
+    void sliderDragStarted (Slider*) override { parameter->beginGesture(); }
+    void sliderDragEnded   (Slider*) override { parameter->endGesture(); }
 
     Slider& slider;
     bool ignoreCallbacks{ false };
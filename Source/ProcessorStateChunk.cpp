@@ -0,0 +1,245 @@
+/*
+  ==============================================================================
+
+    ProcessorStateChunk.cpp
+
+  ==============================================================================
+*/
+
+#include "ProcessorStateChunk.h"
+
+constexpr uint32 ProcessorStateChunk::magic;
+constexpr uint16 ProcessorStateChunk::currentVersion;
+constexpr int ProcessorStateChunk::headerSize;
+
+bool ProcessorStateChunk::isBinaryChunk (const void* data, size_t sizeInBytes) noexcept
+{
+    return sizeInBytes >= size_t(headerSize) && ByteOrder::littleEndianInt(data) == magic;
+}
+
+namespace
+{
+    const uint64 prime1 = 11400714785074694791ull;
+    const uint64 prime2 = 14029467366897019727ull;
+    const uint64 prime3 = 1609587929392839161ull;
+    const uint64 prime4 = 9650029242287828579ull;
+    const uint64 prime5 = 2870177450012600261ull;
+
+    inline uint64 rotateLeft (uint64 x, int bits) noexcept { return (x << bits) | (x >> (64 - bits)); }
+
+    inline uint64 hashRound (uint64 accumulator, uint64 input) noexcept
+    {
+        return rotateLeft(accumulator + input * prime2, 31) * prime1;
+    }
+
+    inline uint64 hashMerge (uint64 hash, uint64 accumulator) noexcept
+    {
+        return (hash ^ hashRound(0, accumulator)) * prime1 + prime4;
+    }
+}
+
+uint64 ProcessorStateChunk::hashContent (const void* data, size_t sizeInBytes, uint64 seed) noexcept
+{
+    auto p = static_cast<const uint8*>(data);
+    const uint8* const end = p + sizeInBytes;
+    uint64 hash;
+
+    if (sizeInBytes >= 32)
+    {
+        uint64 v1 = seed + prime1 + prime2, v2 = seed + prime2, v3 = seed, v4 = seed - prime1;
+
+        for (; p + 32 <= end; p += 32)
+        {
+            v1 = hashRound(v1, ByteOrder::littleEndianInt64(p));
+            v2 = hashRound(v2, ByteOrder::littleEndianInt64(p + 8));
+            v3 = hashRound(v3, ByteOrder::littleEndianInt64(p + 16));
+            v4 = hashRound(v4, ByteOrder::littleEndianInt64(p + 24));
+        }
+
+        hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+        hash = hashMerge(hashMerge(hashMerge(hashMerge(hash, v1), v2), v3), v4);
+    }
+    else
+    {
+        hash = seed + prime5;
+    }
+
+    hash += uint64(sizeInBytes);
+
+    for (; p + 8 <= end; p += 8)
+        hash = rotateLeft(hash ^ hashRound(0, ByteOrder::littleEndianInt64(p)), 27) * prime1 + prime4;
+
+    if (p + 4 <= end)
+    {
+        hash = rotateLeft(hash ^ (uint64(ByteOrder::littleEndianInt(p)) * prime1), 23) * prime2 + prime3;
+        p += 4;
+    }
+
+    for (; p < end; ++p)
+        hash = rotateLeft(hash ^ (*p * prime5), 11) * prime1;
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+bool ProcessorStateChunk::compress (const void* blob, size_t blobSize, MemoryBlock& dest)
+{
+    dest.setSize(0);
+
+    {
+        MemoryOutputStream out(dest, false);
+        GZIPCompressorOutputStream zipper(out);
+        zipper.write(blob, blobSize);
+    }
+
+    if (dest.getSize() < blobSize)
+        return true;
+
+    dest.setSize(0);
+    return false;
+}
+
+bool ProcessorStateChunk::decompress (const void* blob, size_t blobSize, size_t uncompressedSize, MemoryBlock& dest)
+{
+    jassert(uncompressedSize > 0);
+
+    // The size comes from the chunk, so don't allocate whatever it claims.
+    // Deflate can't do better than about 1032:1, and read() takes an int.
+    if (uncompressedSize > size_t(std::numeric_limits<int>::max())
+        || uint64(uncompressedSize) > uint64(blobSize) * 1032)
+    {
+        dest.reset();
+        return false;
+    }
+
+    MemoryInputStream in(blob, blobSize, false);
+    GZIPDecompressorInputStream unzipper(in);
+
+    dest.setSize(uncompressedSize);
+
+    if (unzipper.read(dest.getData(), int(uncompressedSize)) != int(uncompressedSize))
+    {
+        dest.reset();
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Writer
+ */
+
+ProcessorStateChunk::Writer::Writer (MemoryBlock& destData, int numParameters, int numData, uint16 flags)
+    : out(destData, false), numParameters(numParameters), flags(flags)
+{
+    out.preallocate(size_t(headerSize + numParameters * 8));
+
+    out.writeInt(int(magic));
+    out.writeShort(short(currentVersion));
+    out.writeShort(short(flags));
+    out.writeInt(numParameters);
+    out.writeInt(numData);
+}
+
+void ProcessorStateChunk::Writer::writeParameters (const uint32* idHashes, const float* values)
+{
+    for (int i = 0; i < numParameters; ++i)
+        out.writeInt(int(idHashes[i]));
+
+    for (int i = 0; i < numParameters; ++i)
+        out.writeFloat(values[i]);
+}
+
+void ProcessorStateChunk::Writer::writeData (uint32 idHash, uint32 generation, const void* blob, size_t blobSize, size_t uncompressedSize)
+{
+    jassert(uncompressedSize == 0 || (flags & compressedData) != 0);
+
+    out.writeInt(int(idHash));
+    out.writeInt(int(generation));
+    out.writeInt(int(blobSize));
+
+    if ((flags & compressedData) != 0)
+        out.writeInt(int(uncompressedSize));
+
+    out.write(blob, blobSize);
+}
+
+/*
+ * Reader
+ */
+
+bool ProcessorStateChunk::Reader::read (const void* data, size_t sizeInBytes)
+{
+    idHashes.clearQuick();
+    values.clearQuick();
+    dataEntries.clearQuick();
+
+    if (! isBinaryChunk(data, sizeInBytes))
+        return false;
+
+    const uint8* p = static_cast<const uint8*>(data);
+    const uint8* const end = p + sizeInBytes;
+
+    version = ByteOrder::littleEndianShort(p + 4);
+    flags = ByteOrder::littleEndianShort(p + 6);
+    const uint32 numParameters = ByteOrder::littleEndianInt(p + 8);
+    const uint32 numData = ByteOrder::littleEndianInt(p + 12);
+    p += headerSize;
+
+    if (version > currentVersion)
+        return false;
+
+    if (uint64(end - p) < uint64(numParameters) * 8)
+        return false;
+
+    idHashes.ensureStorageAllocated(int(numParameters));
+    values.ensureStorageAllocated(int(numParameters));
+
+    for (uint32 i = 0; i < numParameters; ++i, p += 4)
+        idHashes.add(ByteOrder::littleEndianInt(p));
+
+    for (uint32 i = 0; i < numParameters; ++i, p += 4)
+    {
+        const uint32 bits = ByteOrder::littleEndianInt(p);
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        values.add(value);
+    }
+
+    const bool hasUncompressedSizes = (flags & compressedData) != 0;
+    const int entryHeaderSize = hasUncompressedSizes ? 16 : 12;
+
+    for (uint32 i = 0; i < numData; ++i)
+    {
+        if (end - p < entryHeaderSize)
+            return false;
+
+        const uint32 idHash = ByteOrder::littleEndianInt(p);
+        const uint32 generation = ByteOrder::littleEndianInt(p + 4);
+        const uint32 size = ByteOrder::littleEndianInt(p + 8);
+        const uint32 uncompressedSize = hasUncompressedSizes ? ByteOrder::littleEndianInt(p + 12) : 0;
+        p += entryHeaderSize;
+
+        if (uint32(end - p) < size)
+            return false;
+
+        dataEntries.add({ idHash, generation, p, size, uncompressedSize });
+        p += size;
+    }
+
+    return true;
+}
+
+const ProcessorStateChunk::Reader::DataEntry* ProcessorStateChunk::Reader::findData (uint32 idHash) const noexcept
+{
+    for (const auto& entry : dataEntries)
+        if (entry.idHash == idHash)
+            return &entry;
+
+    return nullptr;
+}
@@ -0,0 +1,142 @@
+/*
+  ==============================================================================
+
+    ProcessorStateChunk.h
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "JuceHeader.h"
+
+/**
+ * The binary chunk written by ProcessorState::getStateInformation().
+ *
+ * Everything is little-endian:
+ *
+ *   header      uint32 magic, uint16 version, uint16 flags,
+ *               uint32 numParameters, uint32 numData
+ *   parameters  uint32 idHash[numParameters], float value[numParameters]
+ *   data        numData x { uint32 idHash, uint32 generation, uint32 size,
+ *                           [uint32 uncompressedSize], uint8 blob[size] }
+ *
+ * Parameter values are unnormalised and keyed by ProcessorState::hashID() of
+ * the parameter ID, so chunks still load after parameters are added or
+ * reordered.  Each data blob is whatever the Data object's ValueTree wrote
+ * with ValueTree::writeToStream(), and is stored with the item's
+ * Data::getGeneration() at the time.  Comparing the generations in two chunks
+ * saved by the same instance shows which items changed in between.
+ *
+ * If the header has the compressedData flag, every data entry has an
+ * uncompressedSize field.  When it isn't 0 the blob is zlib-compressed and
+ * inflates to that many bytes; when it is 0 the blob is stored as it is.
+ *
+ * Chunks that don't start with the magic number are assumed to be the old
+ * XML format from AudioProcessor::copyXmlToBinary().
+ */
+class ProcessorStateChunk
+{
+public:
+    static constexpr uint32 magic = 0x4b485350;    // "PSHK"
+    static constexpr uint16 currentVersion = 1;
+    static constexpr int headerSize = 16;
+
+    enum Flags
+    {
+        /** The data entries have an uncompressedSize field. */
+        compressedData = 1
+    };
+
+    /** Returns true if the data starts with a binary chunk header. */
+    static bool isBinaryChunk (const void* data, size_t sizeInBytes) noexcept;
+
+    /**
+    * Returns a 64-bit hash of a blob's contents, for spotting a data blob
+    * that's the same as one seen before.  This is XXH64, which runs at
+    * several GB/s.
+    */
+    static uint64 hashContent (const void* data, size_t sizeInBytes, uint64 seed = 0) noexcept;
+
+    /** Deflates a blob with zlib into dest.  Returns false, leaving dest
+     * empty, if that didn't make it any smaller. */
+    static bool compress (const void* blob, size_t blobSize, MemoryBlock& dest);
+
+    /** Inflates a blob from compress() into dest, which must come out at
+     * exactly uncompressedSize bytes.  Returns false, leaving dest empty, if
+     * the blob is corrupt or uncompressedSize is implausible for its size. */
+    static bool decompress (const void* blob, size_t blobSize, size_t uncompressedSize, MemoryBlock& dest);
+
+    /**
+     * Writes a chunk.  Call writeParameters() once, then writeData() numData
+     * times.
+     */
+    class Writer
+    {
+    public:
+        /** @param flags  a combination of Flags */
+        Writer (MemoryBlock& destData, int numParameters, int numData, uint16 flags = 0);
+
+        void writeParameters (const uint32* idHashes, const float* values);
+
+        /** Pass the size before compression as uncompressedSize if the blob
+         * came from compress(), or 0 if it didn't.  Compressed blobs need
+         * the compressedData flag. */
+        void writeData (uint32 idHash, uint32 generation, const void* blob, size_t blobSize, size_t uncompressedSize = 0);
+
+    private:
+        MemoryOutputStream out;
+        const int numParameters;
+        const uint16 flags;
+
+        JUCE_DECLARE_NON_COPYABLE (Writer)
+    };
+
+    /**
+     * Checks a chunk and finds the parts of it.  The data blobs point into
+     * the chunk, so it has to outlive the Reader.
+     */
+    class Reader
+    {
+    public:
+        /** Returns false if the chunk is truncated, corrupt or from a newer version. */
+        bool read (const void* data, size_t sizeInBytes);
+
+        struct DataEntry
+        {
+            uint32 idHash;
+            uint32 generation;
+            const void* blob;
+            size_t size;
+            size_t uncompressedSize;    // 0 if the blob isn't compressed
+
+            bool isCompressed () const noexcept { return uncompressedSize != 0; }
+
+            /** Inflates a compressed blob into dest.  Returns false, leaving
+             * dest empty, if it's corrupt or claims an implausible size. */
+            bool decompress (MemoryBlock& dest) const
+            {
+                return ProcessorStateChunk::decompress(blob, size, uncompressedSize, dest);
+            }
+        };
+
+        uint16 getVersion () const noexcept { return version; }
+        uint16 getFlags () const noexcept { return flags; }
+
+        int getNumParameters () const noexcept { return idHashes.size(); }
+        const uint32* getParameterHashes () const noexcept { return idHashes.begin(); }
+        const float* getParameterValues () const noexcept { return values.begin(); }
+
+        int getNumData () const noexcept { return dataEntries.size(); }
+        const DataEntry& getData (int index) const noexcept { return dataEntries.getReference(index); }
+
+        /** Returns nullptr if there's no data with this ID hash. */
+        const DataEntry* findData (uint32 idHash) const noexcept;
+
+    private:
+        uint16 version{ 0 };
+        uint16 flags{ 0 };
+        Array<uint32> idHashes;
+        Array<float> values;
+        Array<DataEntry> dataEntries;
+    };
+};
@@ -0,0 +1,147 @@
+/*
+  ==============================================================================
+
+    ProcessorStateCompactSample.cpp
+
+  ==============================================================================
+*/
+
+#include "ProcessorStateCompactSample.h"
+
+namespace
+{
+    const size_t cacheLine = 64;
+    const int chunkSize = 256;
+
+    ProcessorStateCompactSample::Format chooseFormat (const AudioFormatReader& reader) noexcept
+    {
+        // Only float files hand back float bits from AudioFormatReader::read().
+        // 32-bit integer files are kept at 24 bits, which is below the noise
+        // floor of any converter they came from.
+        if (reader.usesFloatingPointData)
+            return ProcessorStateCompactSample::floatingPoint;
+
+        return reader.bitsPerSample > 16 ? ProcessorStateCompactSample::twentyFourBit
+                                         : ProcessorStateCompactSample::sixteenBit;
+    }
+}
+
+ProcessorStateCompactSample::ProcessorStateCompactSample (AudioFormatReader& reader)
+    : numChannels(int(reader.numChannels)),
+      length(reader.lengthInSamples),
+      sampleRate(reader.sampleRate),
+      format(chooseFormat(reader))
+{
+    channelStride = (size_t(length) * size_t(getBytesPerSample(format)) + cacheLine - 1) & ~(cacheLine - 1);
+
+    storage.calloc(size_t(numChannels) * channelStride + cacheLine);
+    channelData = reinterpret_cast<char*>((reinterpret_cast<pointer_sized_uint>(storage.getData()) + cacheLine - 1) & ~(cacheLine - 1));
+
+    // AudioFormatReader hands back left-justified 32-bit integers (or float
+    // bits, for float files), which are narrowed a block at a time.
+    const int blockSize = 4096;
+    HeapBlock<int> block(size_t(numChannels) * blockSize);
+    HeapBlock<int*> blockChannels(numChannels);
+
+    for (int channel = 0; channel < numChannels; ++channel)
+        blockChannels[channel] = block + channel * blockSize;
+
+    const int bytesPerSample = getBytesPerSample(format);
+
+    for (int64 position = 0; position < length; position += blockSize)
+    {
+        const int count = int(jmin(int64(blockSize), length - position));
+        reader.read(blockChannels, numChannels, position, count, false);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            store(blockChannels[channel], channelData + size_t(channel) * channelStride + size_t(position) * size_t(bytesPerSample), count);
+    }
+}
+
+int ProcessorStateCompactSample::getBytesPerSample (Format format) noexcept
+{
+    switch (format)
+    {
+        case sixteenBit: return 2;
+        case twentyFourBit: return 3;
+        case floatingPoint: return 4;
+    }
+
+    jassertfalse;
+    return 4;
+}
+
+void ProcessorStateCompactSample::store (const int* source, char* dest, int numSamples) const noexcept
+{
+    switch (format)
+    {
+        case sixteenBit:
+        {
+            auto d = reinterpret_cast<int16*>(dest);
+
+            for (int i = 0; i < numSamples; ++i)
+                d[i] = int16(source[i] >> 16);
+
+            break;
+        }
+
+        case twentyFourBit:
+        {
+            for (int i = 0; i < numSamples; ++i, dest += 3)
+            {
+                const uint32 v = uint32(source[i]) >> 8;
+                dest[0] = char(v);
+                dest[1] = char(v >> 8);
+                dest[2] = char(v >> 16);
+            }
+
+            break;
+        }
+
+        case floatingPoint:
+            memcpy(dest, source, size_t(numSamples) * sizeof(float));
+            break;
+    }
+}
+
+void ProcessorStateCompactSample::read (int channel, int64 startSample, float* dest, int numSamples) const noexcept
+{
+    jassert(isPositiveAndBelow(channel, numChannels));
+    jassert(startSample >= 0 && startSample + numSamples <= length);
+
+    const char* source = getChannelData(channel);
+
+    if (format == floatingPoint)
+    {
+        FloatVectorOperations::copy(dest, reinterpret_cast<const float*>(source) + startSample, numSamples);
+        return;
+    }
+
+    int widened[chunkSize];
+
+    for (int done = 0; done < numSamples; done += chunkSize)
+    {
+        const int count = jmin(chunkSize, numSamples - done);
+        const int64 first = startSample + done;
+
+        // Simple enough loops for the compiler to vectorise.
+        if (format == sixteenBit)
+        {
+            const int16* s = reinterpret_cast<const int16*>(source) + first;
+
+            for (int i = 0; i < count; ++i)
+                widened[i] = s[i];
+
+            FloatVectorOperations::convertFixedToFloat(dest + done, widened, 1.0f / 32768.0f, count);
+        }
+        else
+        {
+            const uint8* s = reinterpret_cast<const uint8*>(source) + first * 3;
+
+            for (int i = 0; i < count; ++i, s += 3)
+                widened[i] = int32(uint32(s[0]) << 8 | uint32(s[1]) << 16 | uint32(s[2]) << 24) >> 8;
+
+            FloatVectorOperations::convertFixedToFloat(dest + done, widened, 1.0f / 8388608.0f, count);
+        }
+    }
+}
@@ -0,0 +1,78 @@
+/*
+  ==============================================================================
+
+    ProcessorStateCompactSample.h
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "JuceHeader.h"
+
+/**
+ * Decoded audio kept at the bit depth of the file it came from.
+ *
+ * 16-bit files are stored as 16-bit integers and 24-bit files as packed
+ * 3-byte integers, so they take a half or three quarters of the memory of an
+ * AudioBuffer<float>, and playback reads that much less memory.  32-bit
+ * integer files are stored at 24 bits, and float files as floats.  Each
+ * channel starts on a cache line.
+ *
+ * read() converts to float as it goes: the integers are widened into a small
+ * buffer on the stack and scaled with
+ * FloatVectorOperations::convertFixedToFloat(), which is vectorised.
+ *
+ * THREADING SPEC: Immutable once constructed.  read() doesn't allocate or
+ * lock.
+ */
+class ProcessorStateCompactSample
+{
+public:
+    enum Format
+    {
+        sixteenBit,
+        twentyFourBit,
+        floatingPoint
+    };
+
+    /** Reads the whole of reader into memory. */
+    explicit ProcessorStateCompactSample (AudioFormatReader& reader);
+
+    int getNumChannels () const noexcept { return numChannels; }
+    int64 getLengthInSamples () const noexcept { return length; }
+    double getSampleRate () const noexcept { return sampleRate; }
+    Format getFormat () const noexcept { return format; }
+
+    /** Returns the memory holding the samples. */
+    size_t getMemoryUsage () const noexcept { return sizeof(*this) + size_t(numChannels) * channelStride; }
+
+    /** Converts numSamples samples of a channel, from startSample on, into dest. */
+    void read (int channel, int64 startSample, float* dest, int numSamples) const noexcept;
+
+private:
+    static int getBytesPerSample (Format format) noexcept;
+    const char* getChannelData (int channel) const noexcept { return channelData + size_t(channel) * channelStride; }
+
+    void store (const int* source, char* dest, int numSamples) const noexcept;
+
+    const int numChannels;
+    const int64 length;
+    const double sampleRate;
+    const Format format;
+
+    HeapBlock<char> storage;
+    char* channelData{ nullptr };
+    size_t channelStride{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE (ProcessorStateCompactSample)
+};
+
+/** For the ProcessorStateReclaimer's counters, when a sample is published
+ * through a shared_ptr (as ProcessorStateSampleCache hands them out).  Only
+ * the last reference frees the memory, so a sample that something else,
+ * such as the cache, still holds counts as nothing.
+ * @see getProcessorStatePayloadSize */
+inline size_t getProcessorStatePayloadSize (const std::shared_ptr<const ProcessorStateCompactSample>& sample) noexcept
+{
+    return sample != nullptr && sample.use_count() == 1 ? sample->getMemoryUsage() : 0;
+}
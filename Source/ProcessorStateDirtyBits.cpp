@@ -0,0 +1,41 @@
+/*
+  ==============================================================================
+
+    ProcessorStateDirtyBits.cpp
+
+  ==============================================================================
+*/
+
+#include "ProcessorStateDirtyBits.h"
+
+void ProcessorStateDirtyBits::setSize (int numBits)
+{
+    const int newNumLeaves = jmax(1, (numBits + 31) / 32);
+    const int newNumSummaryWords = (newNumLeaves + 31) / 32;
+
+    if (newNumLeaves == numLeaves)
+        return;
+
+    std::unique_ptr<std::atomic<uint32>[]> newLeaves (new std::atomic<uint32>[size_t(newNumLeaves)]);
+    std::unique_ptr<std::atomic<uint32>[]> newSummary (new std::atomic<uint32>[size_t(newNumSummaryWords)]);
+
+    for (int i = 0; i < newNumLeaves; ++i)
+        newLeaves[i].store(i < numLeaves ? leaves[i].load() : 0, std::memory_order_relaxed);
+
+    for (int i = 0; i < newNumSummaryWords; ++i)
+        newSummary[i].store(i < numSummaryWords ? summary[i].load() : 0, std::memory_order_relaxed);
+
+    leaves.swap(newLeaves);
+    summary.swap(newSummary);
+    numLeaves = newNumLeaves;
+    numSummaryWords = newNumSummaryWords;
+}
+
+bool ProcessorStateDirtyBits::isAnySet () const noexcept
+{
+    for (int s = 0; s < numSummaryWords; ++s)
+        if (summary[s].load(std::memory_order_acquire) != 0)
+            return true;
+
+    return false;
+}
@@ -0,0 +1,94 @@
+/*
+  ==============================================================================
+
+    ProcessorStateDirtyBits.h
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "JuceHeader.h"
+
+/**
+ * A two-level atomic bitset for tracking which parameters have changed.
+ *
+ * set() marks a bit in a leaf word and the leaf's bit in a summary word, so
+ * the reader only visits leaves whose summary bit is set and only calls back
+ * for bits that are actually set.  The cost of take() grows with the number
+ * of changes rather than the number of bits.
+ *
+ * THREADING SPEC: setSize() may only be called while nothing else is using
+ * the bitset.  set() may be called from any thread and is wait-free.  take()
+ * should only be called from one thread at a time.
+ */
+class ProcessorStateDirtyBits
+{
+public:
+    ProcessorStateDirtyBits () = default;
+
+    /** Resizes the bitset, keeping any bits already set. */
+    void setSize (int numBits);
+
+    void set (int bit) noexcept
+    {
+        const uint32 leafBit = uint32(1) << (bit & 31);
+        const int leaf = bit >> 5;
+
+        // If the leaf already had bits set then whoever set them has set (or
+        // is about to set) the summary bit, or the reader is about to take
+        // this leaf anyway.
+        if (leaves[leaf].fetch_or(leafBit, std::memory_order_release) == 0)
+            summary[leaf >> 5].fetch_or(uint32(1) << (leaf & 31), std::memory_order_release);
+    }
+
+    /** Returns true if any bit might be set. */
+    bool isAnySet () const noexcept;
+
+    /** Clears every set bit, calling callback(bit) for each.  Returns true if
+     * any were set. */
+    template <typename Callback>
+    bool take (Callback&& callback)
+    {
+        bool any = false;
+
+        for (int s = 0; s < numSummaryWords; ++s)
+        {
+            if (summary[s].load(std::memory_order_relaxed) == 0)
+                continue;
+
+            for (uint32 leafBits = summary[s].exchange(0, std::memory_order_acquire); leafBits != 0; leafBits &= leafBits - 1)
+            {
+                const int leaf = (s << 5) + findLowestSetBit(leafBits);
+
+                for (uint32 bits = leaves[leaf].exchange(0, std::memory_order_acquire); bits != 0; bits &= bits - 1)
+                {
+                    callback((leaf << 5) + findLowestSetBit(bits));
+                    any = true;
+                }
+            }
+        }
+
+        return any;
+    }
+
+    static int findLowestSetBit (uint32 v) noexcept
+    {
+        jassert(v != 0);
+
+       #if JUCE_MSVC
+        unsigned long i;
+        _BitScanForward(&i, v);
+        return int(i);
+       #else
+        return __builtin_ctz(v);
+       #endif
+    }
+
+private:
+    std::unique_ptr<std::atomic<uint32>[]> leaves;
+    std::unique_ptr<std::atomic<uint32>[]> summary;
+    int numLeaves{ 0 };
+    int numSummaryWords{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE (ProcessorStateDirtyBits)
+};
@@ -0,0 +1,52 @@
+/*
+  ==============================================================================
+
+    ProcessorStateEpochs.cpp
+
+  ==============================================================================
+*/
+
+#include "ProcessorStateEpochs.h"
+
+ProcessorStateEpochs::ProcessorStateEpochs ()
+{
+    readers[0].store(0);
+    readers[1].store(0);
+}
+
+int ProcessorStateEpochs::enter () const noexcept
+{
+    for (;;)
+    {
+        const uint32 e = epoch.load();
+        const int parity = int(e & 1);
+
+        readers[parity].fetch_add(1);
+
+        // If the epoch moved before we were counted, synchronize() may not
+        // have seen us, so count ourselves against the new one instead.
+        if (epoch.load() == e)
+            return parity;
+
+        readers[parity].fetch_sub(1);
+    }
+}
+
+void ProcessorStateEpochs::exit (int parity) const noexcept
+{
+    readers[parity].fetch_sub(1, std::memory_order_release);
+}
+
+void ProcessorStateEpochs::synchronize ()
+{
+    const ScopedLock sl(writerLock);
+
+    const uint32 e = epoch.load();
+    epoch.store(e + 1);
+
+    // New readers are counted against the new epoch, so this only waits for
+    // the ones that were already in.  Readers hold a scope for a block at
+    // most, so this is short.
+    while (readers[e & 1].load(std::memory_order_acquire) != 0)
+        Thread::yield();
+}
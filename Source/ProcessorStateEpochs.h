@@ -0,0 +1,65 @@
+/*
+  ==============================================================================
+
+    ProcessorStateEpochs.h
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "JuceHeader.h"
+
+/**
+ * Read-side epochs for handing objects to the audio thread without locks.
+ *
+ * Readers bracket their use of a shared object with a ReadScope, which just
+ * counts them in and out against the current epoch.  A writer swaps in a new
+ * object and then calls synchronize(), which moves to the next epoch and
+ * waits for the readers counted against the old one to leave.  After that no
+ * reader can still be looking at the old object, so it can be freed.
+ *
+ * Only two epochs are ever live, so the reader counts are a pair indexed by
+ * the epoch's parity.  A reader that loses a race with synchronize() moves
+ * itself to the new epoch and tries again, so entering never blocks.
+ *
+ * You normally use this through ProcessorStatePayload.
+ *
+ * THREADING SPEC: ReadScope may be used on any thread, including the audio
+ * thread; it doesn't allocate or lock.  synchronize() waits, so never call
+ * it on the audio thread.
+ */
+class ProcessorStateEpochs
+{
+public:
+    ProcessorStateEpochs ();
+
+    class ReadScope
+    {
+    public:
+        explicit ReadScope (const ProcessorStateEpochs& epochs) noexcept
+            : epochs(epochs), parity(epochs.enter())
+        {}
+
+        ~ReadScope () { epochs.exit(parity); }
+
+    private:
+        const ProcessorStateEpochs& epochs;
+        const int parity;
+
+        JUCE_DECLARE_NON_COPYABLE (ReadScope)
+    };
+
+    /** Returns once every ReadScope that was open when this was called has
+     * closed. */
+    void synchronize ();
+
+private:
+    int enter () const noexcept;
+    void exit (int parity) const noexcept;
+
+    mutable std::atomic<int> readers[2];
+    std::atomic<uint32> epoch{ 0 };
+    CriticalSection writerLock;
+
+    JUCE_DECLARE_NON_COPYABLE (ProcessorStateEpochs)
+};
@@ -0,0 +1,157 @@
+/*
+  ==============================================================================
+
+    ProcessorStateEventQueue.cpp
+
+  ==============================================================================
+*/
+
+#include "ProcessorStateEventQueue.h"
+
+ProcessorStateEventQueue::ProcessorStateEventQueue (int capacity)
+{
+    uint32 size = 2;
+
+    while (size < uint32(capacity))
+        size <<= 1;
+
+    mask = size - 1;
+    cells.reset(new Cell[size]);
+
+    for (uint32 i = 0; i < size; ++i)
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+
+    blockEvents.ensureStorageAllocated(int(size));
+}
+
+bool ProcessorStateEventQueue::push (int slot, float value, int sampleOffset) noexcept
+{
+    if (! inUse.load(std::memory_order_relaxed))
+        return true;
+
+    uint32 pos = tail.load(std::memory_order_relaxed);
+
+    for (;;)
+    {
+        Cell& cell = cells[pos & mask];
+        const int32 diff = int32(cell.sequence.load(std::memory_order_acquire) - pos);
+
+        if (diff == 0)
+        {
+            if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                cell.event = { slot, value, sampleOffset };
+                cell.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0)
+        {
+            overflowed.store(true, std::memory_order_relaxed);
+            ++numDropped;
+            return false;
+        }
+        else
+        {
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+ProcessorStateEventQueue::Segments ProcessorStateEventQueue::splitBlock (int numSamples, float* values, const ProcessorStateParameterBank& bank) noexcept
+{
+    // The values start out from the bank (needsResync is set), so nothing
+    // pushed before this first call is missed.
+    inUse.store(true, std::memory_order_relaxed);
+    blockEvents.clearQuick();
+
+    // Take at most one ring's worth, so producers can't keep us here.
+    for (uint32 n = 0; n <= mask; ++n)
+    {
+        Cell& cell = cells[head & mask];
+
+        if (int32(cell.sequence.load(std::memory_order_acquire) - (head + 1)) < 0)
+            break;
+
+        Event e = cell.event;
+        cell.sequence.store(head + mask + 1, std::memory_order_release);
+        ++head;
+
+        e.sampleOffset = jlimit(0, jmax(0, numSamples - 1), e.sampleOffset);
+
+        // Arrival order is almost sorted already, so an insertion sort is cheap.
+        int i = blockEvents.size();
+        blockEvents.add(e);
+
+        while (i > 0 && blockEvents.getReference(i - 1).sampleOffset > e.sampleOffset)
+        {
+            blockEvents.getReference(i) = blockEvents.getReference(i - 1);
+            --i;
+        }
+
+        blockEvents.getReference(i) = e;
+    }
+
+    // Some events were dropped, so the queued ones may be older than the bank.
+    // Take the bank's values and forget the timing for this block.
+    if (overflowed.exchange(false, std::memory_order_relaxed))
+    {
+        needsResync = true;
+        blockEvents.clearQuick();
+    }
+
+    if (needsResync)
+    {
+        bank.copyValues(values);
+        needsResync = false;
+    }
+
+    nextEvent = 0;
+    blockLength = numSamples;
+    blockValues = values;
+    blockBank = &bank;
+
+    return { *this, numSamples };
+}
+
+int ProcessorStateEventQueue::applyEventsUpTo (int sample) noexcept
+{
+    const int numEvents = blockEvents.size();
+
+    if (nextEvent >= numEvents)
+        return blockLength;
+
+    while (nextEvent < numEvents && blockEvents.getReference(nextEvent).sampleOffset <= sample)
+    {
+        const Event& e = blockEvents.getReference(nextEvent++);
+        blockValues[e.slot] = e.value;
+    }
+
+    if (nextEvent < numEvents)
+        return blockEvents.getReference(nextEvent).sampleOffset;
+
+    // Two threads setting the same parameter can push in the opposite order
+    // to the one they wrote the bank in, leaving the last event with the
+    // older value.  The bank has the right one, so finish on that.
+    for (const auto& e : blockEvents)
+        blockValues[e.slot] = blockBank->getValue(e.slot);
+
+    return blockLength;
+}
+
+ProcessorStateEventQueue::Segments::Iterator ProcessorStateEventQueue::Segments::begin () const noexcept
+{
+    return { queue, numSamples > 0 ? 0 : numSamples };
+}
+
+ProcessorStateEventQueue::Segment ProcessorStateEventQueue::Segments::Iterator::operator* () const noexcept
+{
+    const int end = queue.applyEventsUpTo(start);
+    return { start, end - start, queue.blockValues };
+}
+
+ProcessorStateEventQueue::Segments::Iterator& ProcessorStateEventQueue::Segments::Iterator::operator++ () noexcept
+{
+    start = queue.applyEventsUpTo(start);
+    return *this;
+}
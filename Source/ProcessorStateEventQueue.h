@@ -0,0 +1,145 @@
+/*
+  ==============================================================================
+
+    ProcessorStateEventQueue.h
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "JuceHeader.h"
+#include "ProcessorStateParameterBank.h"
+
+/**
+ * A preallocated queue of parameter changes, filled by whichever threads call
+ * Parameter::setValue() and drained by the audio thread a block at a time.
+ *
+ * Each event records the parameter's bank slot, its new value and where in
+ * the next block it takes effect.  splitBlock() lets processBlock walk the
+ * block in segments, with the values updated at each event boundary.
+ * Changes from the host's setValue() arrive before the block they belong to
+ * and so take effect at its start; sources that know the sample, such as
+ * MIDI controllers, can say where.
+ *
+ * Pushing is lock-free and never allocates (the ring is a bounded
+ * multi-producer, single-consumer queue with per-cell sequence numbers).  If
+ * the ring fills up the next block resynchronises from the bank, losing the
+ * timing but not the values.  Nothing is queued until splitBlock() is first
+ * called, so a processor that doesn't use it doesn't fill the ring.
+ */
+class ProcessorStateEventQueue
+{
+public:
+    /** @param capacity  rounded up to a power of two */
+    explicit ProcessorStateEventQueue (int capacity = 4096);
+
+    /**
+     * Records a change.  Returns false if the queue was full.  Does nothing
+     * (and returns true) before the first splitBlock().
+     *
+     * THREADING SPEC: Any thread.  Doesn't allocate or lock.
+     */
+    bool push (int slot, float value) noexcept { return push(slot, value, 0); }
+
+    /**
+     * Records a change that takes effect sampleOffset samples into the next
+     * block.  Returns false if the queue was full.
+     *
+     * THREADING SPEC: Any thread.  Doesn't allocate or lock.
+     */
+    bool push (int slot, float value, int sampleOffset) noexcept;
+
+    /** A stretch of the block over which no parameter changes. */
+    struct Segment
+    {
+        int start;
+        int length;
+
+        /** Unnormalised values, indexed by bank slot, for this segment. */
+        const float* values;
+    };
+
+    /** The segments of a block.  Use in a range-based for loop. */
+    class Segments
+    {
+    public:
+        class Iterator
+        {
+        public:
+            Segment operator* () const noexcept;
+            Iterator& operator++ () noexcept;
+            bool operator!= (const Iterator& other) const noexcept { return start != other.start; }
+
+        private:
+            friend class Segments;
+            Iterator (ProcessorStateEventQueue& q, int s) noexcept : queue(q), start(s) {}
+
+            ProcessorStateEventQueue& queue;
+            int start;
+        };
+
+        Iterator begin () const noexcept;
+        Iterator end () const noexcept { return { queue, numSamples }; }
+
+    private:
+        friend class ProcessorStateEventQueue;
+        Segments (ProcessorStateEventQueue& q, int n) noexcept : queue(q), numSamples(n) {}
+
+        ProcessorStateEventQueue& queue;
+        int numSamples;
+    };
+
+    /**
+     * Drains the queue for a block of numSamples and returns its segments.
+     *
+     * Events are placed at their sample offsets, clamped to the block, and
+     * events at the same offset are applied in the order they were pushed.
+     * After a block's last event, the parameters it changed are read back
+     * from the bank, so racing writers can't leave a stale value behind.
+     * values is the audio-side copy of the parameter values,
+     * with room for bank.size() floats; it's updated as the segments are
+     * visited.
+     *
+     * THREADING SPEC: Audio thread only.  Doesn't allocate or lock.
+     */
+    Segments splitBlock (int numSamples, float* values, const ProcessorStateParameterBank& bank) noexcept;
+
+    /** Returns the number of events dropped because the queue was full. */
+    int getNumDropped () const noexcept { return numDropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Event
+    {
+        int slot;
+        float value;
+        int sampleOffset;
+    };
+
+    struct Cell
+    {
+        std::atomic<uint32> sequence;
+        Event event;
+    };
+
+    /** Applies the events due at or before sample and returns the offset of
+     * the next one, or the end of the block. */
+    int applyEventsUpTo (int sample) noexcept;
+
+    std::unique_ptr<Cell[]> cells;
+    uint32 mask;
+    std::atomic<uint32> tail{ 0 };
+    uint32 head{ 0 };
+    std::atomic<bool> inUse{ false };    // set by the first splitBlock()
+    std::atomic<bool> overflowed{ false };
+    std::atomic<int> numDropped{ 0 };
+
+    /* Audio thread state. */
+    Array<Event> blockEvents;
+    int nextEvent{ 0 };
+    int blockLength{ 0 };
+    float* blockValues{ nullptr };
+    const ProcessorStateParameterBank* blockBank{ nullptr };
+    bool needsResync{ true };
+
+    JUCE_DECLARE_NON_COPYABLE (ProcessorStateEventQueue)
+};
@@ -0,0 +1,140 @@
+/*
+  ==============================================================================
+
+    ProcessorStateMorph.cpp
+
+  ==============================================================================
+*/
+
+#include "ProcessorStateMorph.h"
+
+void ProcessorStateMorph::setSize (int newNumSnapshots, int newNumParameters, const Array<bool>& discrete)
+{
+    numSnapshots = newNumSnapshots;
+    numParameters = newNumParameters;
+
+    discreteParameters.clear();
+
+    for (int i = 0; i < numParameters; ++i)
+        if (discrete[i])
+            discreteParameters.add(i);
+
+    targets.reset(new std::atomic<float>[size_t(numSnapshots)]);
+
+    for (int n = 0; n < numSnapshots; ++n)
+        targets[n].store(0.0f);
+
+    weights.calloc(size_t(numSnapshots));
+
+    std::unique_ptr<Snapshots> empty(new Snapshots());
+    empty->values.calloc(size_t(numSnapshots) * size_t(numParameters));
+    empty->isSet.calloc(size_t(numSnapshots));
+    snapshots.publish(std::move(empty));
+}
+
+void ProcessorStateMorph::setSnapshot (int index, const float* unnormalisedValues)
+{
+    jassert(isPositiveAndBelow(index, numSnapshots));
+
+    const ScopedLock sl(snapshotLock);
+    const size_t numValues = size_t(numSnapshots) * size_t(numParameters);
+
+    // The audio thread may be reading the current set, so copy it, change
+    // the copy and publish that.
+    std::unique_ptr<Snapshots> updated(new Snapshots());
+    updated->values.malloc(numValues);
+    updated->isSet.malloc(size_t(numSnapshots));
+
+    {
+        ProcessorStatePayload<Snapshots>::Reader current (snapshots);
+        memcpy(updated->values, current->values, numValues * sizeof(float));
+        memcpy(updated->isSet, current->isSet, size_t(numSnapshots) * sizeof(bool));
+    }
+
+    memcpy(updated->values + size_t(index) * size_t(numParameters), unnormalisedValues, size_t(numParameters) * sizeof(float));
+    updated->isSet[index] = true;
+
+    snapshots.publish(std::move(updated));
+    ++changeCount;
+}
+
+void ProcessorStateMorph::setWeights (const float* newWeights, int numWeights) noexcept
+{
+    for (int n = 0; n < numSnapshots; ++n)
+        targets[n].store(n < numWeights ? jmax(0.0f, newWeights[n]) : 0.0f, std::memory_order_relaxed);
+
+    ++changeCount;
+}
+
+bool ProcessorStateMorph::process (int numSamples, float* dest, int& heaviest) noexcept
+{
+    const uint32 count = changeCount.load();
+    bool changed = (count != lastChangeCount);
+    lastChangeCount = count;
+
+    // Glide each weight towards its target.
+    const float glideSamples = glideSeconds.load(std::memory_order_relaxed) * float(sampleRate);
+    const float maxStep = glideSamples > 0.0f ? float(numSamples) / glideSamples : 1.0f;
+
+    for (int n = 0; n < numSnapshots; ++n)
+    {
+        const float target = targets[n].load(std::memory_order_relaxed);
+
+        if (weights[n] != target)
+        {
+            weights[n] = target > weights[n] ? jmin(target, weights[n] + maxStep)
+                                             : jmax(target, weights[n] - maxStep);
+            changed = true;
+        }
+    }
+
+    if (! changed)
+        return false;
+
+    ProcessorStatePayload<Snapshots>::Reader current (snapshots);
+
+    if (! current)
+        return false;
+
+    float total = 0.0f;
+    heaviest = -1;
+
+    for (int n = 0; n < numSnapshots; ++n)
+    {
+        if (! current->isSet[n] || weights[n] <= 0.0f)
+            continue;
+
+        total += weights[n];
+
+        if (heaviest < 0 || weights[n] > weights[heaviest])
+            heaviest = n;
+    }
+
+    if (heaviest < 0)
+        return false;
+
+    bool first = true;
+
+    for (int n = 0; n < numSnapshots; ++n)
+    {
+        if (! current->isSet[n] || weights[n] <= 0.0f)
+            continue;
+
+        const float* source = current->values + size_t(n) * size_t(numParameters);
+        const float weight = weights[n] / total;
+
+        if (first)
+            FloatVectorOperations::copyWithMultiply(dest, source, weight, numParameters);
+        else
+            FloatVectorOperations::addWithMultiply(dest, source, weight, numParameters);
+
+        first = false;
+    }
+
+    const float* heaviestValues = current->values + size_t(heaviest) * size_t(numParameters);
+
+    for (auto i : discreteParameters)
+        dest[i] = heaviestValues[i];
+
+    return true;
+}
@@ -0,0 +1,92 @@
+/*
+  ==============================================================================
+
+    ProcessorStateMorph.h
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "JuceHeader.h"
+#include "ProcessorStatePayload.h"
+
+/**
+ * Blends the parameter values of several stored snapshots, for an XY pad
+ * between four presets or a crossfader between two.  ProcessorState owns
+ * one; use it through ProcessorState::enableMorph() and friends.
+ *
+ * The snapshots are kept as one contiguous array of unnormalised values per
+ * snapshot, and each blend is a weighted sum of those arrays done with
+ * FloatVectorOperations.  Discrete parameters aren't blended: they take
+ * their value from whichever snapshot has the most weight.
+ *
+ * The weights glide to new targets over the glide time, so a UI that sends
+ * weights at 30Hz still gives a blend that moves every block.
+ *
+ * THREADING SPEC: setSize() during construction.  setSnapshot() from any
+ * thread except the audio thread; it publishes a new set of snapshots that
+ * the audio thread picks up without locking.  setWeights() and
+ * setGlideTime() from any thread.  process() from the audio thread only.
+ */
+class ProcessorStateMorph
+{
+public:
+    explicit ProcessorStateMorph (ProcessorStateReclaimer& reclaimer) : snapshots(reclaimer) {}
+
+    /** discrete[i] is true for parameters that switch rather than blend. */
+    void setSize (int numSnapshots, int numParameters, const Array<bool>& discrete);
+
+    int getNumSnapshots () const noexcept { return numSnapshots; }
+
+    /** Replaces a snapshot's unnormalised values.  Snapshots that haven't
+     * been set take no part in the blend. */
+    void setSnapshot (int index, const float* unnormalisedValues);
+
+    /** Sets the target weight of the first numWeights snapshots; the rest get
+     * 0.  The weights needn't add up to 1. */
+    void setWeights (const float* weights, int numWeights) noexcept;
+
+    /** Sets how long the weights take to move from one target to the next.
+     * The default is 20ms; 0 jumps straight there. */
+    void setGlideTime (double seconds) noexcept { glideSeconds = float(seconds); }
+
+    void prepare (double newSampleRate) noexcept { sampleRate = newSampleRate; }
+
+    /**
+    * Moves the weights numSamples further towards their targets and writes
+    * the blended values to dest, which has room for every parameter.
+    * heaviest is set to the snapshot with the most weight.
+    *
+    * Returns false, leaving dest alone, if nothing has changed since the
+    * last call or no snapshot has any weight.
+    *
+    * THREADING SPEC: Audio thread only.  Doesn't allocate or lock.
+    */
+    bool process (int numSamples, float* dest, int& heaviest) noexcept;
+
+private:
+    struct Snapshots
+    {
+        HeapBlock<float> values;    // numSnapshots x numParameters
+        HeapBlock<bool> isSet;
+    };
+
+    int numSnapshots{ 0 };
+    int numParameters{ 0 };
+    Array<int> discreteParameters;
+
+    ProcessorStatePayload<Snapshots> snapshots;
+    CriticalSection snapshotLock;    // serialises setSnapshot() calls
+
+    /* targets and changeCount are written by any thread; everything after
+     * them belongs to the audio thread. */
+    std::unique_ptr<std::atomic<float>[]> targets;
+    std::atomic<uint32> changeCount{ 0 };
+    std::atomic<float> glideSeconds{ 0.02f };
+
+    HeapBlock<float> weights;
+    uint32 lastChangeCount{ 0 };
+    double sampleRate{ 44100.0 };
+
+    JUCE_DECLARE_NON_COPYABLE (ProcessorStateMorph)
+};
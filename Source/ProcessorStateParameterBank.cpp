@@ -0,0 +1,107 @@
+/*
+  ==============================================================================
+
+    ProcessorStateParameterBank.cpp
+
+  ==============================================================================
+*/
+
+#include "ProcessorStateParameterBank.h"
+
+constexpr int ProcessorStateParameterBank::maxConsistentReadAttempts;
+
+int ProcessorStateParameterBank::add (NormalisableRange<float> range, float defaultValue)
+{
+   #if JUCE_DEBUG
+    // Adding a parameter moves the value arrays, so something is now holding
+    // a dangling pointer from getRawValue().  Create all your parameters before
+    // taking raw value pointers.
+    jassert(! rawValuesTaken);
+   #endif
+
+    const int slot = numSlots;
+    const int newSize = numSlots + 1;
+
+    values.resize(numSlots, newSize);
+    normalisedValues.resize(numSlots, newSize);
+    dirty.setSize(newSize);
+
+    starts.add(range.start);
+    ends.add(range.end);
+    intervals.add(range.interval);
+    skews.add(range.skew);
+    symmetricSkews.add(range.symmetricSkew);
+
+    numSlots = newSize;
+
+    values[slot].store(defaultValue);
+    normalisedValues[slot].store(range.convertTo0to1(defaultValue));
+
+    // Make sure listeners pick up the initial value.
+    dirty.set(slot);
+
+    return slot;
+}
+
+std::atomic<float>* ProcessorStateParameterBank::getRawValue (int slot) const noexcept
+{
+   #if JUCE_DEBUG
+    rawValuesTaken = true;
+   #endif
+
+    return &values[slot];
+}
+
+bool ProcessorStateParameterBank::setValue (int slot, float newValue) noexcept
+{
+    ++activeWriters;
+    const bool changed = values[slot].exchange(newValue) != newValue;
+
+    if (changed)
+    {
+        normalisedValues[slot].store(getRange(slot).convertTo0to1(newValue), std::memory_order_relaxed);
+        ++writeEpoch;
+    }
+
+    --activeWriters;
+
+    if (changed)
+        dirty.set(slot);
+
+    return changed;
+}
+
+NormalisableRange<float> ProcessorStateParameterBank::getRange (int slot) const noexcept
+{
+    return { starts.getUnchecked(slot), ends.getUnchecked(slot), intervals.getUnchecked(slot),
+             skews.getUnchecked(slot), symmetricSkews.getUnchecked(slot) };
+}
+
+void ProcessorStateParameterBank::copyValues (float* dest) const noexcept
+{
+    for (int i = 0; i < numSlots; ++i)
+        dest[i] = values[i].load(std::memory_order_relaxed);
+}
+
+bool ProcessorStateParameterBank::copyConsistentValues (float* dest) const noexcept
+{
+    for (int attempt = 1;; ++attempt)
+    {
+        const uint32 epoch = writeEpoch.load();
+        const bool startedQuiet = activeWriters.load() == 0;
+
+        copyValues(dest);
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // A writer that was already going is caught by startedQuiet, one that
+        // finished during the copy moved the epoch, and one still going is
+        // caught by activeWriters.
+        if (startedQuiet && activeWriters.load() == 0 && writeEpoch.load() == epoch)
+            return true;
+
+        if (attempt == maxConsistentReadAttempts)
+            return false;
+
+        Thread::yield();
+    }
+}
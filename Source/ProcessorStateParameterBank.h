@@ -0,0 +1,127 @@
+/*
+  ==============================================================================
+
+    ProcessorStateParameterBank.h
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "JuceHeader.h"
+#include "ProcessorStateDirtyBits.h"
+
+/**
+ * Structure-of-arrays storage for the hot data of every ProcessorState
+ * parameter.
+ *
+ * Each field lives in its own contiguous array indexed by slot, so reading
+ * all the values for a block, or scanning for parameters that need a UI
+ * update, is a linear sweep through memory rather than a walk over separately
+ * allocated Parameter objects.  The Parameter objects themselves are views of
+ * a slot and keep the cold metadata (names, text functions, listeners).
+ *
+ * THREADING SPEC: add() may only be called while the processor is being
+ * constructed.  Everything else may be called from any thread.
+ */
+class ProcessorStateParameterBank
+{
+public:
+    ProcessorStateParameterBank () = default;
+
+    /** Adds a slot and returns its index.  This reallocates the arrays, so any
+     * raw value pointers handed out before this call become invalid. */
+    int add (NormalisableRange<float> range, float defaultValue);
+
+    int size () const noexcept { return numSlots; }
+
+    /** Returns the unnormalised value. */
+    float getValue (int slot) const noexcept { return values[slot].load(std::memory_order_relaxed); }
+
+    /** Returns the normalised value. */
+    float getNormalisedValue (int slot) const noexcept { return normalisedValues[slot].load(std::memory_order_relaxed); }
+
+    /** Returns the unnormalised value for a realtime process to read. */
+    std::atomic<float>* getRawValue (int slot) const noexcept;
+
+    /**
+     * Stores a new unnormalised value, which should already be a legal value
+     * for the slot's range, and marks the slot dirty if it changed.  Returns
+     * true if the value changed.
+     */
+    bool setValue (int slot, float newValue) noexcept;
+
+    NormalisableRange<float> getRange (int slot) const noexcept;
+
+    /** Copies every unnormalised value into dest, which must have room for size() floats. */
+    void copyValues (float* dest) const noexcept;
+
+    /**
+     * Like copyValues(), but the values are all from one moment: no
+     * setValue() happened part way through the copy.
+     *
+     * This is a seqlock read.  setValue() counts itself in and out of
+     * activeWriters and bumps writeEpoch when it's done; the copy is retried
+     * if either shows a write overlapped it.  Writers never wait.  Retries
+     * back off by yielding, and after maxConsistentReadAttempts the last copy
+     * is used and false is returned, so heavy automation can't keep the
+     * caller spinning.
+     *
+     * THREADING SPEC: Any thread except the audio thread (it may yield).
+     */
+    bool copyConsistentValues (float* dest) const noexcept;
+
+    /** Clears the dirty flag of every slot that has one set, calling
+     * callback(slot) for each.  Returns true if any were dirty.  This costs
+     * time in proportion to the number of dirty slots, not the number of
+     * slots. */
+    template <typename Callback>
+    bool takeDirty (Callback&& callback)
+    {
+        return dirty.take(callback);
+    }
+
+    /** Returns true if any slot might be dirty. */
+    bool isAnyDirty () const noexcept { return dirty.isAnySet(); }
+
+private:
+    /** A heap array of atomics that can be resized while nothing else is
+     * using it. */
+    template <typename Type>
+    class AtomicArray
+    {
+    public:
+        void resize (int oldSize, int newSize)
+        {
+            std::unique_ptr<std::atomic<Type>[]> newElements (new std::atomic<Type>[size_t(newSize)]);
+
+            for (int i = 0; i < newSize; ++i)
+                newElements[i].store(i < oldSize ? elements[i].load() : Type(), std::memory_order_relaxed);
+
+            elements.swap(newElements);
+        }
+
+        std::atomic<Type>& operator[] (int i) const noexcept { return elements[i]; }
+
+    private:
+        std::unique_ptr<std::atomic<Type>[]> elements;
+    };
+
+    AtomicArray<float> values;
+    AtomicArray<float> normalisedValues;
+    ProcessorStateDirtyBits dirty;
+
+    static constexpr int maxConsistentReadAttempts = 16;
+    std::atomic<int> activeWriters{ 0 };
+    std::atomic<uint32> writeEpoch{ 0 };
+
+    Array<float> starts, ends, intervals, skews;
+    Array<bool> symmetricSkews;
+
+    int numSlots{ 0 };
+
+   #if JUCE_DEBUG
+    mutable bool rawValuesTaken{ false };
+   #endif
+
+    JUCE_DECLARE_NON_COPYABLE (ProcessorStateParameterBank)
+};
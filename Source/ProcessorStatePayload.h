@@ -0,0 +1,91 @@
+/*
+  ==============================================================================
+
+    ProcessorStatePayload.h
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "JuceHeader.h"
+#include "ProcessorStateReclaimer.h"
+
+/**
+ * Returns the memory a payload holds, for the ProcessorStateReclaimer's
+ * counters and limit.  Overload it for your own payload types.
+ */
+template <typename Type>
+size_t getProcessorStatePayloadSize (const Type&) noexcept { return sizeof(Type); }
+
+template <typename SampleType>
+size_t getProcessorStatePayloadSize (const AudioBuffer<SampleType>& buffer) noexcept
+{
+    return sizeof(buffer) + size_t(buffer.getNumChannels()) * size_t(buffer.getNumSamples()) * sizeof(SampleType);
+}
+
+/**
+ * Holds an immutable object, such as a sample buffer or a zone map, that a
+ * Data item builds and the audio thread reads.
+ *
+ * publish() swaps the new object in with one atomic exchange.  The audio
+ * thread reads through a Reader, which sees either the complete old object
+ * or the complete new one and never locks.  The old object goes to the
+ * ProcessorStateReclaimer, which deletes it on its own thread once no Reader
+ * can still see it.
+ *
+ * @code
+ * // audio thread
+ * ProcessorStatePayload<AudioBuffer<float>>::Reader sample (sampleFile->getPayload());
+ *
+ * if (sample)
+ *     play (*sample.get());
+ * @endcode
+ *
+ * THREADING SPEC: Readers may be created on any thread, including the audio
+ * thread.  Call publish() from a loading or message thread.
+ */
+template <typename Type>
+class ProcessorStatePayload
+{
+public:
+    explicit ProcessorStatePayload (ProcessorStateReclaimer& reclaimer) : reclaimer(reclaimer) {}
+
+    ~ProcessorStatePayload () { delete current.load(); }
+
+    /** Keeps the object it found alive for as long as it exists.  Keep it on
+     * the stack and drop it by the end of the block. */
+    class Reader
+    {
+    public:
+        explicit Reader (const ProcessorStatePayload& payload) noexcept
+            : scope(payload.reclaimer.getEpochs()), object(payload.current.load(std::memory_order_acquire))
+        {}
+
+        /** Returns nullptr if nothing has been published. */
+        const Type* get () const noexcept { return object; }
+        const Type* operator-> () const noexcept { return object; }
+        explicit operator bool () const noexcept { return object != nullptr; }
+
+    private:
+        ProcessorStateEpochs::ReadScope scope;
+        const Type* const object;
+
+        JUCE_DECLARE_NON_COPYABLE (Reader)
+    };
+
+    /** Makes newObject (which may be nullptr) the one readers see and retires
+     * the one it replaces. */
+    void publish (std::unique_ptr<Type> newObject)
+    {
+        const Type* old = current.exchange(newObject.release(), std::memory_order_acq_rel);
+
+        if (old != nullptr)
+            reclaimer.retire(old, getProcessorStatePayloadSize(*old));
+    }
+
+private:
+    ProcessorStateReclaimer& reclaimer;
+    std::atomic<const Type*> current{ nullptr };
+
+    JUCE_DECLARE_NON_COPYABLE (ProcessorStatePayload)
+};
@@ -0,0 +1,120 @@
+/*
+  ==============================================================================
+
+    ProcessorStateReclaimer.cpp
+
+  ==============================================================================
+*/
+
+#include "ProcessorStateReclaimer.h"
+
+constexpr int ProcessorStateReclaimer::batchIntervalMs;
+
+ProcessorStateReclaimer::ProcessorStateReclaimer (ProcessorStateEpochs& epochs)
+    : Thread("ProcessorState reclaimer"), epochs(epochs)
+{
+}
+
+ProcessorStateReclaimer::~ProcessorStateReclaimer ()
+{
+    signalThreadShouldExit();
+    notify();
+    stopThread(2000);
+
+    Array<Retired> remaining;
+
+    {
+        const ScopedLock sl(lock);
+        remaining.swapWith(pending);
+    }
+
+    reclaim(remaining);
+}
+
+void ProcessorStateReclaimer::setMaximumPendingBytes (size_t maximumBytes)
+{
+    const ScopedLock sl(lock);
+    maximumPendingBytes = maximumBytes;
+}
+
+ProcessorStateReclaimer::Statistics ProcessorStateReclaimer::getStatistics () const
+{
+    const ScopedLock sl(lock);
+    return statistics;
+}
+
+void ProcessorStateReclaimer::retire (Retired item)
+{
+    Array<Retired> overflow;
+
+    {
+        const ScopedLock sl(lock);
+
+        pending.add(item);
+        ++statistics.numRetired;
+        statistics.pendingBytes += item.size;
+        statistics.peakPendingBytes = jmax(statistics.peakPendingBytes, statistics.pendingBytes);
+
+        if (statistics.pendingBytes > maximumPendingBytes)
+        {
+            ++statistics.numForcedReclaims;
+            overflow.swapWith(pending);
+        }
+        else if (! isThreadRunning())
+        {
+            // Low priority: nothing is waiting on the memory.
+            startThread(1);
+        }
+    }
+
+    if (overflow.size() > 0)
+        reclaim(overflow);
+    else
+        notify();
+}
+
+void ProcessorStateReclaimer::reclaim (Array<Retired>& items)
+{
+    if (items.size() == 0)
+        return;
+
+    // One grace period covers everything in the batch.
+    epochs.synchronize();
+
+    size_t bytes = 0;
+
+    for (const auto& item : items)
+    {
+        item.destroy(item.object);
+        bytes += item.size;
+    }
+
+    const ScopedLock sl(lock);
+    statistics.pendingBytes -= bytes;
+    statistics.numReclaimed += items.size();
+    items.clearQuick();
+}
+
+void ProcessorStateReclaimer::run ()
+{
+    while (! threadShouldExit())
+    {
+        wait(-1);
+
+        if (threadShouldExit())
+            break;
+
+        // Let a burst of publishes (a preset with several samples) collect
+        // so they share one grace period.
+        wait(batchIntervalMs);
+
+        Array<Retired> items;
+
+        {
+            const ScopedLock sl(lock);
+            items.swapWith(pending);
+        }
+
+        reclaim(items);
+    }
+}
@@ -0,0 +1,87 @@
+/*
+  ==============================================================================
+
+    ProcessorStateReclaimer.h
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "JuceHeader.h"
+#include "ProcessorStateEpochs.h"
+
+/**
+ * Frees objects replaced by ProcessorStatePayload::publish() on a
+ * low-priority background thread, so neither the audio thread nor the thread
+ * publishing waits for a large free.
+ *
+ * retire() queues the object.  The background thread takes everything
+ * queued, waits once for ProcessorStateEpochs::synchronize() so that no
+ * reader can still see any of it, and deletes the lot.
+ *
+ * The memory waiting to be freed is bounded: if a retire() takes the pending
+ * total over the maximum set with setMaximumPendingBytes(), the retiring
+ * thread reclaims the queue itself instead of leaving it for the background
+ * thread.
+ *
+ * THREADING SPEC: retire() may be called from any thread except the audio
+ * thread.
+ */
+class ProcessorStateReclaimer : private Thread
+{
+public:
+    explicit ProcessorStateReclaimer (ProcessorStateEpochs& epochs);
+
+    /** Frees anything still queued. */
+    ~ProcessorStateReclaimer ();
+
+    ProcessorStateEpochs& getEpochs () const noexcept { return epochs; }
+
+    /** Queues object to be deleted once no reader can see it.  sizeInBytes
+     * is only used for the counters and the limit. */
+    template <typename Type>
+    void retire (const Type* object, size_t sizeInBytes)
+    {
+        retire({ object, [](const void* o) { delete static_cast<const Type*>(o); }, sizeInBytes });
+    }
+
+    /** Sets the most memory that may wait to be freed before retire() frees
+     * it on the spot.  The default is 256MB. */
+    void setMaximumPendingBytes (size_t maximumBytes);
+
+    struct Statistics
+    {
+        /** Objects queued and objects freed so far. */
+        int64 numRetired, numReclaimed;
+
+        /** Times retire() went over the limit and freed the queue itself. */
+        int64 numForcedReclaims;
+
+        /** Memory queued but not yet freed, now and at most. */
+        size_t pendingBytes, peakPendingBytes;
+    };
+
+    Statistics getStatistics () const;
+
+private:
+    struct Retired
+    {
+        const void* object;
+        void (*destroy) (const void*);
+        size_t size;
+    };
+
+    void retire (Retired item);
+    void reclaim (Array<Retired>& items);
+    void run () override;
+
+    static constexpr int batchIntervalMs = 100;
+
+    ProcessorStateEpochs& epochs;
+    CriticalSection lock;
+    Array<Retired> pending;
+    size_t maximumPendingBytes{ 256 * 1024 * 1024 };
+    Statistics statistics{ 0, 0, 0, 0, 0 };
+
+    JUCE_DECLARE_NON_COPYABLE (ProcessorStateReclaimer)
+};
@@ -0,0 +1,175 @@
+/*
+  ==============================================================================
+
+    ProcessorStateSampleCache.cpp
+
+  ==============================================================================
+*/
+
+#include "ProcessorStateSampleCache.h"
+
+ProcessorStateSampleCache::ProcessorStateSampleCache ()
+{
+    formatManager.registerBasicFormats();
+}
+
+String ProcessorStateSampleCache::makeKey (const File& file)
+{
+    const File target = file.getLinkedTarget();
+
+    return target.getFullPathName()
+        + "|" + String(target.getLastModificationTime().toMilliseconds())
+        + "|" + String(target.getSize());
+}
+
+ProcessorStateSampleCache::SamplePtr ProcessorStateSampleCache::getSample (const File& file)
+{
+    if (! file.existsAsFile())
+        return nullptr;
+
+    const String key = makeKey(file);
+    std::shared_ptr<PendingLoad> pending;
+    bool isLoader = false;
+
+    {
+        const ScopedLock sl(lock);
+
+        if (Entry* entry = findEntry(key))
+        {
+            if (SamplePtr sample = entry->weak.lock())
+            {
+                ++statistics.numHits;
+                entry->lastUsed = ++useCounter;
+
+                if (entry->strong == nullptr)
+                {
+                    entry->strong = sample;
+                    statistics.cachedBytes += entry->bytes;
+                    trimToBudget();
+                }
+
+                return sample;
+            }
+
+            if (entry->pending != nullptr)
+            {
+                ++statistics.numSharedLoads;
+                pending = entry->pending;
+            }
+            else
+            {
+                // Dropped and no longer used anywhere.
+                entries.removeObject(entry);
+            }
+        }
+
+        if (pending == nullptr)
+        {
+            ++statistics.numMisses;
+            isLoader = true;
+
+            Entry* entry = entries.add(new Entry());
+            entry->key = key;
+            entry->pending = pending = std::make_shared<PendingLoad>();
+            entry->bytes = 0;
+            entry->lastUsed = ++useCounter;
+        }
+    }
+
+    if (! isLoader)
+    {
+        pending->done.wait();
+        return pending->result;
+    }
+
+    const SamplePtr sample = decode(file);
+
+    {
+        const ScopedLock sl(lock);
+
+        if (Entry* entry = findEntry(key))
+        {
+            entry->pending = nullptr;
+
+            if (sample != nullptr)
+            {
+                entry->strong = sample;
+                entry->weak = sample;
+                entry->bytes = sample->getMemoryUsage();
+                statistics.cachedBytes += entry->bytes;
+                trimToBudget();
+            }
+            else
+            {
+                entries.removeObject(entry);
+            }
+        }
+
+        pending->result = sample;
+    }
+
+    pending->done.signal();
+    return sample;
+}
+
+ProcessorStateSampleCache::SamplePtr ProcessorStateSampleCache::decode (const File& file)
+{
+    ScopedPointer<AudioFormatReader> reader = formatManager.createReaderFor(file);
+
+    if (reader == nullptr)
+        return nullptr;
+
+    return std::make_shared<Sample>(*reader);
+}
+
+ProcessorStateSampleCache::Entry* ProcessorStateSampleCache::findEntry (const String& key) const noexcept
+{
+    for (auto * entry : entries)
+        if (entry->key == key)
+            return entry;
+
+    return nullptr;
+}
+
+void ProcessorStateSampleCache::trimToBudget ()
+{
+    while (statistics.cachedBytes > memoryBudget)
+    {
+        Entry* oldest = nullptr;
+
+        for (auto * entry : entries)
+            if (entry->strong != nullptr && (oldest == nullptr || entry->lastUsed < oldest->lastUsed))
+                oldest = entry;
+
+        if (oldest == nullptr)
+            break;
+
+        // Instances still playing it keep it alive, and can still find it
+        // through the weak reference.
+        oldest->strong = nullptr;
+        statistics.cachedBytes -= oldest->bytes;
+        ++statistics.numEvictions;
+    }
+
+    // Forget files nobody is using any more.
+    for (int i = entries.size(); --i >= 0;)
+    {
+        Entry* entry = entries.getUnchecked(i);
+
+        if (entry->strong == nullptr && entry->pending == nullptr && entry->weak.expired())
+            entries.remove(i);
+    }
+}
+
+void ProcessorStateSampleCache::setMemoryBudget (size_t maximumBytes)
+{
+    const ScopedLock sl(lock);
+    memoryBudget = maximumBytes;
+    trimToBudget();
+}
+
+ProcessorStateSampleCache::Statistics ProcessorStateSampleCache::getStatistics () const
+{
+    const ScopedLock sl(lock);
+    return statistics;
+}
@@ -0,0 +1,108 @@
+/*
+  ==============================================================================
+
+    ProcessorStateSampleCache.h
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "JuceHeader.h"
+#include "ProcessorStateCompactSample.h"
+
+/**
+ * Decoded audio files shared by every plugin instance in the process.
+ *
+ * Thirty instances loading the same kit decode each file once and share one
+ * buffer.  Files are keyed by their canonical path, modification time and
+ * size, so an edited file is decoded again rather than served stale.
+ *
+ * Samples are handed out as shared pointers.  The cache keeps its own
+ * reference to recently used samples, up to a memory budget, and drops the
+ * least recently used ones when it goes over.  A sample that's been dropped
+ * but is still in use somewhere is still found and shared.  If several
+ * threads ask for the same file at once, one decodes it and the rest wait
+ * for the result.
+ *
+ * Hold one with a SharedResourcePointer, so the cache lives as long as any
+ * instance does:
+ *
+ * @code
+ * SharedResourcePointer<ProcessorStateSampleCache> sampleCache;
+ * auto sample = sampleCache->getSample (file);
+ * @endcode
+ *
+ * THREADING SPEC: Any thread except the audio thread.  getSample() may
+ * decode a file.
+ */
+class ProcessorStateSampleCache
+{
+public:
+    ProcessorStateSampleCache ();
+
+    /** Samples are kept at the file's own bit depth; see
+     * ProcessorStateCompactSample. */
+    typedef ProcessorStateCompactSample Sample;
+
+    typedef std::shared_ptr<const Sample> SamplePtr;
+
+    /** Returns the decoded file, or nullptr if it can't be read. */
+    SamplePtr getSample (const File& file);
+
+    /** Sets how much memory the cache's own references may hold.  The
+     * default is 1GB. */
+    void setMemoryBudget (size_t maximumBytes);
+
+    struct Statistics
+    {
+        /** Requests served from memory, requests that decoded the file, and
+         * requests that waited for another thread's decode of the same file. */
+        int64 numHits, numMisses, numSharedLoads;
+
+        /** Samples the cache dropped its reference to for the budget. */
+        int64 numEvictions;
+
+        /** Memory held by the cache's own references. */
+        size_t cachedBytes;
+    };
+
+    Statistics getStatistics () const;
+
+private:
+    /* A decode in progress.  Threads after the same file wait on done. */
+    struct PendingLoad
+    {
+        WaitableEvent done{ true };
+        SamplePtr result;
+    };
+
+    /* Everything known about one file.  strong is the cache's reference and
+     * is dropped for the budget; weak finds the sample while anything else
+     * still uses it. */
+    struct Entry
+    {
+        String key;
+        SamplePtr strong;
+        std::weak_ptr<const Sample> weak;
+        std::shared_ptr<PendingLoad> pending;
+        size_t bytes;
+        uint64 lastUsed;
+    };
+
+    static String makeKey (const File& file);
+    SamplePtr decode (const File& file);
+    Entry* findEntry (const String& key) const noexcept;
+    void trimToBudget ();
+
+    CriticalSection lock;
+    AudioFormatManager formatManager;
+
+    /* Searched linearly: a kit is tens or hundreds of files, and every
+     * lookup is followed by either a copy of a pointer or a decode. */
+    OwnedArray<Entry> entries;
+    uint64 useCounter{ 0 };
+    size_t memoryBudget{ 1024 * 1024 * 1024 };
+    Statistics statistics{ 0, 0, 0, 0, 0 };
+
+    JUCE_DECLARE_NON_COPYABLE (ProcessorStateSampleCache)
+};
@@ -0,0 +1,204 @@
+/*
+  ==============================================================================
+
+    ProcessorStateSampleStream.cpp
+
+  ==============================================================================
+*/
+
+#include "ProcessorStateSampleStream.h"
+
+class ProcessorStateSampleStream::ReadAheadThread : public TimeSliceThread
+{
+public:
+    ReadAheadThread () : TimeSliceThread("ProcessorState read-ahead")
+    {
+        startThread(6);
+    }
+
+    ~ReadAheadThread ()
+    {
+        stopThread(2000);
+    }
+};
+
+/* Ids for streams and cursors.  0 means none. */
+static uint32 nextId ()
+{
+    static std::atomic<uint32> lastId{ 0 };
+    return ++lastId;
+}
+
+ProcessorStateSampleStream::Cursor::Cursor () noexcept
+    : id(nextId())
+{}
+
+std::unique_ptr<ProcessorStateSampleStream> ProcessorStateSampleStream::open (const File& file, double headSeconds, double readAheadSeconds)
+{
+    AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+
+    AudioFormatReader* reader = nullptr;
+
+    // Memory mapped if the format allows it, so the read ahead is a copy out
+    // of the page cache rather than a read call.
+    if (auto format = formatManager.findFormatForFileExtension(file.getFileExtension()))
+    {
+        ScopedPointer<MemoryMappedAudioFormatReader> mapped = format->createMemoryMappedReader(file);
+
+        if (mapped != nullptr && mapped->mapEntireFile())
+            reader = mapped.release();
+    }
+
+    if (reader == nullptr)
+        reader = formatManager.createReaderFor(file);
+
+    if (reader == nullptr || reader->numChannels == 0 || reader->lengthInSamples <= 0)
+    {
+        delete reader;
+        return nullptr;
+    }
+
+    const int headLength = int(jmin(reader->lengthInSamples, int64(headSeconds * reader->sampleRate)));
+    const int ringLength = jmax(1024, int(readAheadSeconds * reader->sampleRate));
+
+    return std::unique_ptr<ProcessorStateSampleStream>(new ProcessorStateSampleStream(reader, jmax(1, headLength), ringLength));
+}
+
+ProcessorStateSampleStream::ProcessorStateSampleStream (AudioFormatReader* r, int headLength, int ringLength)
+    : reader(r),
+      numChannels(int(r->numChannels)),
+      length(r->lengthInSamples),
+      sampleRate(r->sampleRate),
+      headLength(headLength),
+      ringLength(headLength < length ? ringLength : 0),
+      id(nextId()),
+      nextFilePosition(headLength)
+{
+    head.setSize(numChannels, headLength);
+    reader->read(&head, 0, headLength, 0, true, true);
+
+    // Files that fit in the head don't need streaming at all.
+    if (this->ringLength > 0)
+    {
+        ring.setSize(numChannels, this->ringLength);
+        readAheadThread->addTimeSliceClient(this);
+    }
+}
+
+ProcessorStateSampleStream::~ProcessorStateSampleStream ()
+{
+    if (ringLength > 0)
+        readAheadThread->removeTimeSliceClient(this);
+}
+
+size_t ProcessorStateSampleStream::getMemoryUsage () const noexcept
+{
+    return sizeof(*this) + size_t(numChannels) * size_t(headLength + ringLength) * sizeof(float);
+}
+
+int ProcessorStateSampleStream::useTimeSlice ()
+{
+    const int64 space = ringLength - (written.load(std::memory_order_relaxed) - consumed.load(std::memory_order_acquire));
+
+    // Top the ring up in reasonably sized reads rather than a few samples at
+    // a time.
+    if (space < ringLength / 4)
+        return 5;
+
+    const int64 w = written.load(std::memory_order_relaxed);
+    const int count = int(jmin(space, length - nextFilePosition));
+    const int start = int(w % ringLength);
+    const int first = jmin(count, ringLength - start);
+
+    reader->read(&ring, start, first, nextFilePosition, true, true);
+
+    if (count > first)
+        reader->read(&ring, 0, count - first, nextFilePosition + first, true, true);
+
+    written.store(w + count, std::memory_order_release);
+
+    nextFilePosition += count;
+
+    if (nextFilePosition >= length)
+        nextFilePosition = headLength;
+
+    return 0;
+}
+
+bool ProcessorStateSampleStream::read (Cursor& cursor, float* const* dest, int numDestChannels, int numSamples) const noexcept
+{
+    if (cursor.streamId != id)
+    {
+        cursor.streamId = id;
+        cursor.position = 0;
+    }
+
+    int done = 0;
+
+    while (done < numSamples)
+    {
+        int count;
+
+        if (cursor.position < headLength)
+        {
+            count = int(jmin(int64(numSamples - done), headLength - cursor.position));
+            copyOut(head, int(cursor.position), dest, done, numDestChannels, count);
+        }
+        else
+        {
+            uint32 owner = ringOwner.load(std::memory_order_relaxed);
+
+            if (owner != cursor.id && (owner != 0 || ! ringOwner.compare_exchange_strong(owner, cursor.id)))
+            {
+                underrun(cursor, dest, numDestChannels, done, numSamples);
+                return false;
+            }
+
+            const int64 c = consumed.load(std::memory_order_relaxed);
+            const int64 available = written.load(std::memory_order_acquire) - c;
+
+            count = int(jmin(int64(numSamples - done), length - cursor.position, available));
+
+            if (count == 0)
+            {
+                underrun(cursor, dest, numDestChannels, done, numSamples);
+                return false;
+            }
+
+            const int start = int(c % ringLength);
+            const int first = jmin(count, ringLength - start);
+
+            copyOut(ring, start, dest, done, numDestChannels, first);
+
+            if (count > first)
+                copyOut(ring, 0, dest, done + first, numDestChannels, count - first);
+
+            consumed.store(c + count, std::memory_order_release);
+        }
+
+        done += count;
+        cursor.position += count;
+
+        if (cursor.position >= length)
+            cursor.position = 0;
+    }
+
+    return true;
+}
+
+void ProcessorStateSampleStream::underrun (Cursor& cursor, float* const* dest, int numDestChannels, int done, int numSamples) const noexcept
+{
+    for (int channel = 0; channel < numDestChannels; ++channel)
+        FloatVectorOperations::clear(dest[channel] + done, numSamples - done);
+
+    cursor.numUnderruns.fetch_add(1, std::memory_order_relaxed);
+    cursor.numUnderrunSamples.fetch_add(numSamples - done, std::memory_order_relaxed);
+}
+
+void ProcessorStateSampleStream::copyOut (const AudioBuffer<float>& source, int sourceStart, float* const* dest, int destStart,
+                                          int numDestChannels, int numSamples) const noexcept
+{
+    for (int channel = 0; channel < numDestChannels; ++channel)
+        FloatVectorOperations::copy(dest[channel] + destStart, source.getReadPointer(channel % numChannels, sourceStart), numSamples);
+}
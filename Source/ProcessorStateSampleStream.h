@@ -0,0 +1,141 @@
+/*
+  ==============================================================================
+
+    ProcessorStateSampleStream.h
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "JuceHeader.h"
+
+/**
+ * A sample played from disk rather than decoded into memory up front.
+ *
+ * Opening the stream reads a head segment, the first couple of seconds, into
+ * memory, so it can play straight away.  The rest of the file is read ahead
+ * into a ring buffer by a background thread shared by every stream in the
+ * process.  A ten-minute file costs a few seconds of memory instead of the
+ * whole thing.  Files in formats that support it (WAV, AIFF) are memory
+ * mapped; anything else is read through a normal AudioFormatReader.
+ *
+ * Playback is sequential and loops.  The head covers the start of the file
+ * on every pass, so the read-ahead thread only ever streams the part after
+ * it, going round the loop.  If the audio thread catches up with the read
+ * ahead it plays silence for the rest of the block, holds its position and
+ * counts an underrun.
+ *
+ * The stream itself is shared and immutable apart from the ring, so it can
+ * be published as a payload.  The playback position lives in a Cursor that
+ * belongs to whoever is reading.  There is only one read ahead, so the first
+ * cursor to play past the head takes the ring; any other cursor plays the
+ * head and then silence.
+ *
+ * Use it as the payload of a ProcessorStateLoadedFile, with open() in the
+ * loader:
+ *
+ * @code
+ * ProcessorStateLoadedFile<ProcessorStateSampleStream> file { state, "file",
+ *     [](const File& f) { return ProcessorStateSampleStream::open (f); } };
+ *
+ * ProcessorStateSampleStream::Cursor cursor;    // in the processor
+ *
+ * ProcessorStatePayload<ProcessorStateSampleStream>::Reader stream (file.getPayload());
+ * if (stream != nullptr)
+ *     stream->read (cursor, buffer.getArrayOfWritePointers(), buffer.getNumChannels(), buffer.getNumSamples());
+ * @endcode
+ *
+ * THREADING SPEC: read() is for the audio thread; it doesn't allocate or
+ * lock.  A Cursor must only be used by one thread at a time.  Everything
+ * else may be called from any thread.
+ */
+class ProcessorStateSampleStream : private TimeSliceClient
+{
+public:
+    /**
+     * A playback position.  A cursor that's handed a different stream from
+     * last time starts that stream from the beginning.
+     */
+    class Cursor
+    {
+    public:
+        Cursor () noexcept;
+
+        /** Blocks where read() ran out, and the samples it filled with silence. */
+        int64 getNumUnderruns () const noexcept { return numUnderruns.load(std::memory_order_relaxed); }
+        int64 getNumUnderrunSamples () const noexcept { return numUnderrunSamples.load(std::memory_order_relaxed); }
+
+    private:
+        friend class ProcessorStateSampleStream;
+
+        const uint32 id;
+        uint32 streamId{ 0 };
+        int64 position{ 0 };
+        std::atomic<int64> numUnderruns{ 0 };
+        std::atomic<int64> numUnderrunSamples{ 0 };
+
+        JUCE_DECLARE_NON_COPYABLE (Cursor)
+    };
+
+    /** Returns nullptr if the file can't be read. */
+    static std::unique_ptr<ProcessorStateSampleStream> open (const File& file, double headSeconds = 2.0, double readAheadSeconds = 2.0);
+
+    ~ProcessorStateSampleStream ();
+
+    int getNumChannels () const noexcept { return numChannels; }
+    int64 getLengthInSamples () const noexcept { return length; }
+    double getSampleRate () const noexcept { return sampleRate; }
+
+    /** Returns the memory held by the head and the ring. */
+    size_t getMemoryUsage () const noexcept;
+
+    /**
+     * Writes the numSamples samples after the cursor's position to dest,
+     * looping at the end of the file, and moves the cursor on.  Source
+     * channels are repeated if dest has more.  Returns false if there was
+     * nothing to read, because the read ahead couldn't keep up or another
+     * cursor has the ring, in which case the rest of the block is silent.
+     */
+    bool read (Cursor& cursor, float* const* dest, int numDestChannels, int numSamples) const noexcept;
+
+private:
+    class ReadAheadThread;
+
+    ProcessorStateSampleStream (AudioFormatReader* reader, int headLength, int ringLength);
+
+    int useTimeSlice () override;
+    void underrun (Cursor& cursor, float* const* dest, int numDestChannels, int done, int numSamples) const noexcept;
+    void copyOut (const AudioBuffer<float>& source, int sourceStart, float* const* dest, int destStart,
+                  int numDestChannels, int numSamples) const noexcept;
+
+    ScopedPointer<AudioFormatReader> reader;
+    const int numChannels;
+    const int64 length;
+    const double sampleRate;
+
+    AudioBuffer<float> head;
+    AudioBuffer<float> ring;
+    const int headLength;
+    const int ringLength;
+    const uint32 id;
+
+    /* Counts of samples that have gone through the ring, and the id of the
+     * cursor that reads it.  The ring is the one part of the stream that
+     * changes after open(), so these are mutable. */
+    std::atomic<int64> written{ 0 };
+    mutable std::atomic<int64> consumed{ 0 };
+    mutable std::atomic<uint32> ringOwner{ 0 };
+
+    /* Read-ahead thread only. */
+    int64 nextFilePosition;
+
+    SharedResourcePointer<ReadAheadThread> readAheadThread;
+
+    JUCE_DECLARE_NON_COPYABLE (ProcessorStateSampleStream)
+};
+
+/** For the ProcessorStateReclaimer's counters.  @see getProcessorStatePayloadSize */
+inline size_t getProcessorStatePayloadSize (const ProcessorStateSampleStream& stream) noexcept
+{
+    return stream.getMemoryUsage();
+}
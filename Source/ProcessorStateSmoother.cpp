@@ -0,0 +1,223 @@
+/*
+  ==============================================================================
+
+    ProcessorStateSmoother.cpp
+
+  ==============================================================================
+*/
+
+#include "ProcessorStateSmoother.h"
+
+void ProcessorStateSmoother::add (int slot, Type type, double timeSeconds)
+{
+    jassert(timeSeconds >= 0.0);
+
+    // Each parameter should only be added once.
+    jassert(! slots.contains(slot));
+
+    slots.add(slot);
+    types.add(type);
+    rampTypes.add(type);
+    times.add(timeSeconds);
+    currents.add(0.0f);
+    targets.add(0.0f);
+    steps.add(0.0f);
+    remaining.add(0);
+}
+
+void ProcessorStateSmoother::prepare (const ProcessorStateParameterBank& bank, double newSampleRate, int maximumBlockSize)
+{
+    sampleRate = newSampleRate;
+    maxBlockSize = maximumBlockSize;
+
+    const int numEntries = slots.size();
+
+    entryForSlot.clearQuick();
+
+    for (int i = 0; i < bank.size(); ++i)
+        entryForSlot.add(-1);
+
+    movingThisBlock.clearQuick();
+
+    for (int e = 0; e < numEntries; ++e)
+    {
+        entryForSlot.set(slots[e], e);
+        movingThisBlock.add(false);
+
+        const float value = bank.getValue(slots[e]);
+        currents.set(e, value);
+        targets.set(e, value);
+        remaining.set(e, 0);
+    }
+
+    // One cache-line aligned row per entry, plus a row holding 1, 2, 3...
+    // which the linear ramps are scaled from.
+    const int floatsPerLine = 16;
+    stride = (maximumBlockSize + floatsPerLine - 1) / floatsPerLine * floatsPerLine;
+
+    storage.calloc(size_t(stride) * size_t(numEntries + 1) * sizeof(float) + 64);
+    ramps = reinterpret_cast<float*>((reinterpret_cast<pointer_sized_uint>(storage.getData()) + 63) & ~pointer_sized_uint(63));
+    indexRamp = ramps + size_t(stride) * size_t(numEntries);
+
+    for (int i = 0; i < maximumBlockSize; ++i)
+        indexRamp[i] = float(i + 1);
+}
+
+void ProcessorStateSmoother::process (const ProcessorStateParameterBank& bank, int numSamples) noexcept
+{
+    jassert(numSamples <= maxBlockSize);
+    numSamples = jmin(numSamples, maxBlockSize);
+
+    if (numSamples <= 0)
+        return;
+
+    const int numEntries = slots.size();
+
+    for (int e = 0; e < numEntries; ++e)
+    {
+        const float target = bank.getValue(slots.getUnchecked(e));
+
+        if (target != targets.getUnchecked(e))
+            startRamp(e, target);
+
+        const bool moving = remaining.getUnchecked(e) > 0;
+        movingThisBlock.set(e, moving);
+
+        if (moving)
+            fillRamp(e, ramps + size_t(stride) * size_t(e), numSamples);
+    }
+}
+
+ProcessorStateSmoother::Ramp ProcessorStateSmoother::getRamp (const ProcessorStateParameterBank& bank, int slot) const noexcept
+{
+    // Before prepare() there are no entries, so everything is static.
+    if (! isPositiveAndBelow(slot, entryForSlot.size()))
+        return { nullptr, bank.getValue(slot) };
+
+    const int e = entryForSlot.getUnchecked(slot);
+
+    if (e < 0)
+        return { nullptr, bank.getValue(slot) };
+
+    if (movingThisBlock.getUnchecked(e))
+        return { ramps + size_t(stride) * size_t(e), currents.getUnchecked(e) };
+
+    return { nullptr, currents.getUnchecked(e) };
+}
+
+void ProcessorStateSmoother::startRamp (int e, float newTarget) noexcept
+{
+    const float current = currents.getUnchecked(e);
+    const int numSteps = roundToInt(times.getUnchecked(e) * sampleRate);
+
+    targets.set(e, newTarget);
+
+    if (numSteps <= 0)
+    {
+        currents.set(e, newTarget);
+        remaining.set(e, 0);
+        return;
+    }
+
+    int type = types.getUnchecked(e);
+
+    // Can't move multiplicatively through zero, so glide linearly instead.
+    if (type == multiplicative && ! (current > 0.0f && newTarget > 0.0f))
+        type = linear;
+
+    rampTypes.set(e, type);
+
+    switch (type)
+    {
+        case multiplicative:
+            steps.set(e, float(std::exp((std::log(newTarget) - std::log(current)) / numSteps)));
+            remaining.set(e, numSteps);
+            break;
+
+        case onePole:
+            // For one-pole ramps remaining is just a flag; fillRamp() clears
+            // it once the value has settled.
+            steps.set(e, float(std::exp(std::log(0.01) / numSteps)));
+            remaining.set(e, 1);
+            break;
+
+        case linear:
+        default:
+            steps.set(e, (newTarget - current) / float(numSteps));
+            remaining.set(e, numSteps);
+            break;
+    }
+}
+
+void ProcessorStateSmoother::fillRamp (int e, float* dest, int numSamples) noexcept
+{
+    const float current = currents.getUnchecked(e);
+    const float target = targets.getUnchecked(e);
+    const float step = steps.getUnchecked(e);
+
+    if (rampTypes.getUnchecked(e) == onePole)
+    {
+        fillGeometric(dest, (current - target) * step, step, numSamples);
+        FloatVectorOperations::add(dest, target, numSamples);
+
+        const float last = dest[numSamples - 1];
+
+        if (std::abs(last - target) <= 1.0e-5f * jmax(1.0f, std::abs(target)))
+        {
+            currents.set(e, target);
+            remaining.set(e, 0);
+        }
+        else
+        {
+            currents.set(e, last);
+        }
+
+        return;
+    }
+
+    const int count = jmin(numSamples, remaining.getUnchecked(e));
+
+    if (rampTypes.getUnchecked(e) == multiplicative)
+    {
+        fillGeometric(dest, current * step, step, count);
+    }
+    else
+    {
+        FloatVectorOperations::copyWithMultiply(dest, indexRamp, step, count);
+        FloatVectorOperations::add(dest, current, count);
+    }
+
+    remaining.set(e, remaining.getUnchecked(e) - count);
+
+    if (remaining.getUnchecked(e) == 0)
+    {
+        // Land exactly on the target and hold it for the rest of the block.
+        FloatVectorOperations::fill(dest + count - 1, target, numSamples - count + 1);
+        currents.set(e, target);
+    }
+    else
+    {
+        currents.set(e, dest[count - 1]);
+    }
+}
+
+void ProcessorStateSmoother::fillGeometric (float* dest, float first, float ratio, int numSamples) noexcept
+{
+    if (numSamples <= 0)
+        return;
+
+    // dest[i] = first * ratio^i.  Each pass copies everything written so far,
+    // scaled by ratio^filled, so a block takes log2(numSamples) vector passes.
+    dest[0] = first;
+
+    int filled = 1;
+    float power = ratio;
+
+    while (filled < numSamples)
+    {
+        const int count = jmin(filled, numSamples - filled);
+        FloatVectorOperations::copyWithMultiply(dest + filled, dest, power, count);
+        filled += count;
+        power *= power;
+    }
+}
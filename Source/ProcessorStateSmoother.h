@@ -0,0 +1,96 @@
+/*
+  ==============================================================================
+
+    ProcessorStateSmoother.h
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "JuceHeader.h"
+#include "ProcessorStateParameterBank.h"
+
+/**
+ * Generates per-sample ramps for the parameters that have opted into
+ * smoothing.
+ *
+ * Once per block the smoother compares each smoothed parameter's target with
+ * the value in the bank.  Parameters that are moving get a ramp written into
+ * a block-sized buffer using FloatVectorOperations; parameters that are
+ * steady are skipped and read back as a single value.
+ *
+ * You normally use this through ProcessorState::setSmoothing(),
+ * ProcessorState::updateSmoothing() and ProcessorState::getSmoothedValues().
+ */
+class ProcessorStateSmoother
+{
+public:
+    enum Type
+    {
+        /** Moves at a constant rate, reaching the target after the smoothing time. */
+        linear,
+        /** Moves by a constant ratio, reaching the target after the smoothing time.
+         * Good for frequencies and gains.  Falls back to linear if the start or
+         * target isn't positive. */
+        multiplicative,
+        /** Exponential approach, 99% of the way to the target after the
+         * smoothing time. */
+        onePole
+    };
+
+    /** The values for one parameter over the current block. */
+    struct Ramp
+    {
+        /** One value per sample, or nullptr if the parameter isn't moving. */
+        const float* samples;
+
+        /** The value at the end of the block. */
+        float value;
+
+        bool isSmoothing () const noexcept { return samples != nullptr; }
+        float operator[] (int i) const noexcept { return samples != nullptr ? samples[i] : value; }
+    };
+
+    /** Opts a bank slot into smoothing.  Call before prepare(). */
+    void add (int slot, Type type, double timeSeconds);
+
+    /** Allocates the ramp buffers and snaps every smoothed parameter to its
+     * current value. */
+    void prepare (const ProcessorStateParameterBank& bank, double sampleRate, int maximumBlockSize);
+
+    /**
+     * Picks up new targets from the bank and fills the ramps for the next
+     * numSamples samples.  numSamples must be no more than the
+     * maximumBlockSize passed to prepare().
+     *
+     * THREADING SPEC: Audio thread only.  Doesn't allocate or lock.
+     */
+    void process (const ProcessorStateParameterBank& bank, int numSamples) noexcept;
+
+    /** Returns the ramp for a bank slot.  Slots that aren't smoothed, and
+     * every slot before prepare(), return their current value from the bank. */
+    Ramp getRamp (const ProcessorStateParameterBank& bank, int slot) const noexcept;
+
+private:
+    void startRamp (int entry, float newTarget) noexcept;
+    void fillRamp (int entry, float* dest, int numSamples) noexcept;
+
+    static void fillGeometric (float* dest, float first, float ratio, int numSamples) noexcept;
+
+    /* One entry per smoothed parameter, stored as parallel arrays. */
+    Array<int> slots;
+    Array<int> types, rampTypes;
+    Array<double> times;
+    Array<float> currents, targets, steps;
+    Array<int> remaining;
+
+    Array<int> entryForSlot;
+    Array<bool> movingThisBlock;
+
+    HeapBlock<char> storage;
+    float* ramps{ nullptr };
+    float* indexRamp{ nullptr };
+    int stride{ 0 };
+    int maxBlockSize{ 0 };
+    double sampleRate{ 44100.0 };
+};